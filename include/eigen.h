@@ -65,6 +65,16 @@ using Eigen::MatrixXd;
 using Eigen::Vector2i;
 using Eigen::Vector3i;
 using Eigen::Map;
+using Eigen::ArrayXd;
+using ArrayX2d = Eigen::Array<double, Dynamic, 2>;
+using ArrayX3d = Eigen::Array<double, Dynamic, 3>;
+using Eigen::Matrix3Xd;
+
+// point sets, one point per column (Matrix3X) or per row (ArrayX3)
+template<typename T>
+using Matrix3X = Matrix<T, 3, Dynamic>;
+template<typename T>
+using ArrayX3 = Eigen::Array<T, Dynamic, 3>;
 
 using Eigen::JacobiSVD;
 using Eigen::ComputeThinU;
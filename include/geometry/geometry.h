@@ -63,6 +63,7 @@ Matrix3<T> interOmegaRot(const Vector3<T> & v);
 
 #include "geometry/quaternion.h"
 #include "geometry/transformation.h"
+#include "geometry/pose.h"
 #include "geometry/geometry_core.h"
 
 
@@ -0,0 +1,134 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+A rigid transformation stored as a rotation matrix and a translation
+*/
+
+#pragma once
+
+#include "std.h"
+
+#include "eigen.h"
+
+// Redundant companion of Transformation:
+// the rotation matrix is computed once, at the conversion,
+// so transforming single points and composing costs only the matrix products.
+// R^T is not stored, Eigen evaluates the products with R.transpose() directly.
+// Use it for the per-point loops and the transformation chains,
+// keep Transformation for the optimization parameters.
+
+template<typename T>
+class Pose
+{
+public:
+    Pose() : mR(Matrix3<T>::Identity()), mtrans(ZERO, ZERO, ZERO) {}
+
+    Pose(const Matrix3<T> & R, const Vector3<T> & trans) : mR(R), mtrans(trans) {}
+
+    Pose(const Transformation<T> & xi) : mR(xi.rotMat()), mtrans(xi.trans()) {}
+
+    Transformation<T> toTransf() const { return Transformation<T>(mtrans, mR); }
+
+    const Matrix3<T> & rotMat() const { return mR; }
+    Eigen::Transpose<const Matrix3<T>> rotMatInv() const { return mR.transpose(); }
+
+    const Vector3<T> & trans() const { return mtrans; }
+    Vector3<T> transInv() const { return -(mR.transpose() * mtrans); }
+
+    Pose compose(const Pose & pose) const
+    {
+        return Pose(mR * pose.mR, mR * pose.mtrans + mtrans);
+    }
+
+    Pose inverseCompose(const Pose & pose) const
+    {
+        return Pose(mR.transpose() * pose.mR, mR.transpose() * (pose.mtrans - mtrans));
+    }
+
+    Pose composeInverse(const Pose & pose) const
+    {
+        Matrix3<T> R = mR * pose.mR.transpose();
+        return Pose(R, mtrans - R * pose.mtrans);
+    }
+
+    Pose inverse() const
+    {
+        return Pose(mR.transpose(), transInv());
+    }
+
+    void transform(const Vector3<T> & src, Vector3<T> & dst) const
+    {
+        dst = mR * src + mtrans;
+    }
+
+    void inverseTransform(const Vector3<T> & src, Vector3<T> & dst) const
+    {
+        dst = mR.transpose() * (src - mtrans);
+    }
+
+    Vector3<T> transform(const Vector3<T> & src) const { return mR * src + mtrans; }
+
+    Vector3<T> inverseTransform(const Vector3<T> & src) const { return mR.transpose() * (src - mtrans); }
+
+    void transform(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
+    {
+        dst.resize(src.size());
+        for (unsigned int i = 0; i < src.size(); i++)
+        {
+            dst[i] = mR * src[i] + mtrans;
+        }
+    }
+
+    void inverseTransform(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
+    {
+        dst.resize(src.size());
+        for (unsigned int i = 0; i < src.size(); i++)
+        {
+            dst[i] = mR.transpose() * (src[i] - mtrans);
+        }
+    }
+
+    void rotate(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
+    {
+        dst.resize(src.size());
+        for (unsigned int i = 0; i < src.size(); i++)
+        {
+            dst[i] = mR * src[i];
+        }
+    }
+
+    void inverseRotate(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
+    {
+        dst.resize(src.size());
+        for (unsigned int i = 0; i < src.size(); i++)
+        {
+            dst[i] = mR.transpose() * src[i];
+        }
+    }
+
+    friend std::ostream& operator << (std::ostream & os, const Pose & pose)
+    {
+        os << pose.toTransf();
+        return os;
+    }
+
+private:
+    Matrix3<T> mR;
+    Vector3<T> mtrans;
+};
+
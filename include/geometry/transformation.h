@@ -147,21 +147,13 @@ public:
     void transform(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
     {
         dst.resize(src.size());
-        rotate(src, dst);
-        for (unsigned int i = 0; i < dst.size(); i++)
-        {
-            dst[i] = dst[i] + mtrans;
-        }
+        transform(mapCloud(src), mapCloud(dst));
     }
 
     void inverseTransform(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
     {
         dst.resize(src.size());
-        for (unsigned int i = 0; i < src.size(); i++)
-        {
-            dst[i] = src[i] - mtrans;
-        }
-        inverseRotate(dst, dst);
+        inverseTransform(mapCloud(src), mapCloud(dst));
     }
 
     void transform(const Vector3<T> & src, Vector3<T> & dst) const
@@ -180,21 +172,62 @@ public:
     void rotate(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
     {
         dst.resize(src.size());
-        Matrix3<T> R = rotMat();
-        for (unsigned int i = 0; i < src.size(); i++)
-        {
-            dst[i] = R * src[i];
-        }
+        Eigen::Map<Matrix3X<T>> dstMap = mapCloud(dst);
+        affineCols(rotMat(), Vector3<T>(ZERO, ZERO, ZERO), mapCloud(src), dstMap);
     }
 
     void inverseRotate(const Vector3Vec<T> & src, Vector3Vec<T> & dst) const
     {
         dst.resize(src.size());
-        Matrix3<T> R = rotMatInv();
-        for (unsigned int i = 0; i < src.size(); i++)
-        {
-            dst[i] = R * src[i];
-        }
+        Eigen::Map<Matrix3X<T>> dstMap = mapCloud(dst);
+        affineCols(rotMatInv(), Vector3<T>(ZERO, ZERO, ZERO), mapCloud(src), dstMap);
+    }
+    
+    /*
+    Bulk transformations over caller-provided storage
+    - a matrix holds a point per column (3xN, as Matrix3X),
+    an array holds the coordinates x, y, z in its columns (Nx3, as ArrayX3)
+    - dst is not resized and must have the size of src
+    - every point is rotated and translated in a single pass
+    - dst may be src, the transformation is then done in place
+    The points are processed by blocks of contiguous coordinate arrays, vectorized by Eigen
+    dst is taken by const reference, as recommended by Eigen to accept temporary views
+    */
+    template<typename Derived1, typename Derived2>
+    void transform(const Eigen::MatrixBase<Derived1> & src, const Eigen::MatrixBase<Derived2> & dst) const
+    {
+        affineCols(rotMat(), mtrans, src, const_cast<Eigen::MatrixBase<Derived2> &>(dst));
+    }
+    
+    template<typename Derived1, typename Derived2>
+    void inverseTransform(const Eigen::MatrixBase<Derived1> & src, const Eigen::MatrixBase<Derived2> & dst) const
+    {
+        const Matrix3<T> R = rotMatInv();
+        affineCols(R, Vector3<T>(-R * mtrans), src, const_cast<Eigen::MatrixBase<Derived2> &>(dst));
+    }
+    
+    template<typename Derived1, typename Derived2>
+    void transform(const Eigen::ArrayBase<Derived1> & src, const Eigen::ArrayBase<Derived2> & dst) const
+    {
+        affineRows(rotMat(), mtrans, src, const_cast<Eigen::ArrayBase<Derived2> &>(dst));
+    }
+    
+    template<typename Derived1, typename Derived2>
+    void inverseTransform(const Eigen::ArrayBase<Derived1> & src, const Eigen::ArrayBase<Derived2> & dst) const
+    {
+        const Matrix3<T> R = rotMatInv();
+        affineRows(R, Vector3<T>(-R * mtrans), src, const_cast<Eigen::ArrayBase<Derived2> &>(dst));
+    }
+    
+    // views of a point vector as a 3xN matrix, the Eigen vectors are packed
+    static Eigen::Map<const Matrix3X<T>> mapCloud(const Vector3Vec<T> & cloud)
+    {
+        return Eigen::Map<const Matrix3X<T>>(reinterpret_cast<const T *>(cloud.data()), 3, cloud.size());
+    }
+    
+    static Eigen::Map<Matrix3X<T>> mapCloud(Vector3Vec<T> & cloud)
+    {
+        return Eigen::Map<Matrix3X<T>>(reinterpret_cast<T *>(cloud.data()), 3, cloud.size());
     }
 
     std::array<T, 6> toArray() const
@@ -243,6 +276,56 @@ public:
     }
     
 private:
+    enum { BLOCK_SIZE = 256 };
+    typedef Eigen::Array<T, BLOCK_SIZE, 3> BlockArray;
+
+    // dst = R * src + t for 3xN point matrices, in place if dst is src
+    // the points are processed by blocks, each block is transposed into contiguous
+    // coordinate arrays and goes through the same kernel as the Nx3 arrays
+    template<typename Derived1, typename Derived2>
+    static void affineCols(const Matrix3<T> & R, const Vector3<T> & t,
+            const Eigen::MatrixBase<Derived1> & src, Eigen::MatrixBase<Derived2> & dst)
+    {
+        assert(src.rows() == 3 and dst.rows() == 3 and src.cols() == dst.cols());
+        BlockArray input, buffer;
+        for (int i = 0; i < src.cols(); i += BLOCK_SIZE)
+        {
+            const int n = std::min<int>(BLOCK_SIZE, src.cols() - i);
+            input.topRows(n) = src.middleCols(i, n).transpose().array();
+            affineBlock(R, t, input.topRows(n), buffer, n);
+            dst.middleCols(i, n) = buffer.topRows(n).transpose().matrix();
+        }
+    }
+    
+    // the same for Nx3 coordinate arrays, the source columns are already contiguous
+    template<typename Derived1, typename Derived2>
+    static void affineRows(const Matrix3<T> & R, const Vector3<T> & t,
+            const Eigen::ArrayBase<Derived1> & src, Eigen::ArrayBase<Derived2> & dst)
+    {
+        assert(src.cols() == 3 and dst.cols() == 3 and src.rows() == dst.rows());
+        BlockArray buffer;
+        for (int i = 0; i < src.rows(); i += BLOCK_SIZE)
+        {
+            const int n = std::min<int>(BLOCK_SIZE, src.rows() - i);
+            affineBlock(R, t, src.middleRows(i, n), buffer, n);
+            dst.middleRows(i, n) = buffer.topRows(n);
+        }
+    }
+    
+    // each coordinate of the n points is computed from the source coordinate arrays,
+    // the result goes into a buffer so that dst may alias src
+    template<typename Derived>
+    static void affineBlock(const Matrix3<T> & R, const Vector3<T> & t,
+            const Eigen::ArrayBase<Derived> & src, BlockArray & buffer, const int n)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            buffer.col(k).head(n) = R(k, 0) * src.col(0)
+                    + R(k, 1) * src.col(1)
+                    + R(k, 2) * src.col(2) + t[k];
+        }
+    }
+
     Vector3<T> mrot;
     Vector3<T> mtrans;
 
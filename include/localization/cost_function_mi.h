@@ -32,6 +32,11 @@ Cost functions for localization based on photometric data and mutual information
 /*
 Mutual Information cost function 
 //TODO complete the gradient computation explanation
+
+- the bins and shares of the reference values are computed once in the constructor
+- Evaluate works in the scratch buffers of the object and fills the joint histogram
+and the gradient in parallel blocks, so one object must not be evaluated
+from several threads at once
 */
 struct MutualInformation : public FirstOrderFunction
 {
@@ -47,7 +52,9 @@ struct MutualInformation : public FirstOrderFunction
             _histStep(valMax / (numBins - 1)),
             _increment(1. / dataPack.cloud.size()),
             _hist1(computeHist(dataPack.valVec))
-    { }
+    {
+        initReference();
+    }
     
     virtual int NumParameters() const { return 6; }
     
@@ -59,6 +66,10 @@ struct MutualInformation : public FirstOrderFunction
     
     virtual bool Evaluate(double const * parameters, double * cost, double * gradient) const;
     
+    // the body of Evaluate, instantiated for ICamera and for CameraModels
+    template<typename Camera>
+    bool evaluate(const Camera & camera, double const * parameters, double * cost, double * gradient) const;
+    
     void computeShareDerivative(double val, int & idx1, int & idx2, double & der) const;
     
     void computeShares(double val, int & idx1, int & idx2, double & share) const;
@@ -71,6 +82,12 @@ struct MutualInformation : public FirstOrderFunction
     
     vector<double> reduceHist(const vector<double> & hist2d) const;
     
+    // adds a point to the row-major joint histogram hist
+    void addToHist2d(int idx11, int idx12, double share1,
+            int idx21, int idx22, double share2, double * hist) const;
+    
+    void initReference();
+    
     ICamera * _camera;
     const PhotometricPack & _dataPack;
     const Grid2D<float> _imageGrid;
@@ -87,8 +104,46 @@ struct MutualInformation : public FirstOrderFunction
     double _increment;
     
     vector<double> _hist1;
+    
+    // computeShares of _dataPack.valVec
+    vector<int> _refIdx1Vec;
+    vector<int> _refIdx2Vec;
+    vector<double> _refShareVec;
+    
+    // scratch buffers of evaluate, the partial sums are stored per parallel block
+    mutable Vector3dVec _transformedPoints;
+    mutable vector<double> _valVec2;
+    mutable vector<Covector3d> _dfdXVec;
+    mutable vector<double> _partialHistVec;
+    mutable vector<double> _partialGradVec;
+    mutable vector<double> _hist12;
+    mutable vector<double> _hist2;
+    mutable vector<double> _logVec12;
+    
+    const int MIN_BLOCK_SIZE = 1024;
 };
 
+/*
+MutualInformation with the camera model known at compile time,
+see ModelPhotometricCostFunction
+*/
+template<typename Camera>
+struct ModelMutualInformation : public MutualInformation
+{
+    ModelMutualInformation(const Camera * camera, const PhotometricPack & dataPack, const Transf xiBaseCam,
+            const Mat32f & img2, double scale, int numBins, double valMax = 1.) :
+            MutualInformation(camera, dataPack, xiBaseCam, img2, scale, numBins, valMax) {}
+    
+    virtual bool Evaluate(double const * parameters, double * cost, double * gradient) const
+    {
+        return evaluate(static_cast<const Camera &>(*_camera), parameters, cost, gradient);
+    }
+};
+
+// chooses the ModelMutualInformation by the type of camera
+MutualInformation * makeMutualInformation(const ICamera * camera, const PhotometricPack & dataPack,
+        const Transf xiBaseCam, const Mat32f & img2, double scale, int numBins, double valMax = 1.);
+
 struct MutualInformationOdom : public MutualInformation
 {
 
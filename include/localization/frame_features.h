@@ -0,0 +1,100 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Image data shared by the consumers of one frame
+
+- the pyramid of ScalePhotometric, with its Sobel gradients
+- the smoothed gradient magnitude of MotionStereo
+- the Harris response of SparseOdometry
+
+Everything is computed at the first access.
+The consumers keep shallow copies of the matrices, so the data
+must not be modified in place. Not thread-safe.
+*/
+
+#pragma once
+
+#include "std.h"
+#include "eigen.h"
+#include "ocv.h"
+
+#include "reconstruction/eucm_motion_stereo.h"
+#include "localization/scale_space.h"
+
+class FrameFeatures
+{
+public:
+    FrameFeatures(const Mat8u & img, int numScales) :
+            _img(img.clone()),
+            _pyramid(numScales, true),
+            _pyramidReady(false),
+            _gradMagnitudeReady(false),
+            _cornerResponseReady(false) {}
+    
+    const Mat8u & image() const { return _img; }
+    
+    // float pyramid, the gradients are computed at the first access to each level
+    const BinaryScalSpace & pyramid() const
+    {
+        if (not _pyramidReady)
+        {
+            _pyramid.generate(_img);
+            _pyramidReady = true;
+        }
+        return _pyramid;
+    }
+    
+    // see MotionStereo::computeGradientMagnitude
+    const Mat8u & gradientMagnitude() const
+    {
+        if (not _gradMagnitudeReady)
+        {
+            MotionStereo::computeGradientMagnitude(_img, _gradMagnitude);
+            _gradMagnitudeReady = true;
+        }
+        return _gradMagnitude;
+    }
+    
+    // Harris response with the block size 7 and the aperture 3
+    const Mat32f & cornerResponse() const
+    {
+        if (not _cornerResponseReady)
+        {
+            computeCornerResponse(_img, _cornerResponse);
+            _cornerResponseReady = true;
+        }
+        return _cornerResponse;
+    }
+    
+    // for the consumers which are fed with a bare image
+    static void computeCornerResponse(const Mat8u & img, Mat32f & dst)
+    {
+        dst.create(img.size());
+        cornerHarris(img, dst, 7, 3, 0.05);
+    }
+    
+private:
+    Mat8u _img;
+    mutable BinaryScalSpace _pyramid;
+    mutable Mat8u _gradMagnitude;
+    mutable Mat32f _cornerResponse;
+    mutable bool _pyramidReady;
+    mutable bool _gradMagnitudeReady;
+    mutable bool _cornerResponseReady;
+};
+
@@ -0,0 +1,100 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Inverse compositional photometric alignment
+
+The increment is applied to the reference points instead of the target ones,
+so the jacobian of every residual depends only on the reference image
+and is computed once per data pack, together with the Hessian J^T J:
+
+    min_dxi  sum_i [ I1(p(dxi X_i)) - I2(p(T21 X_i)) ]^2,     T21 <- T21 dxi^-1
+
+- X_i are the reference points in the frame of camera 1
+- at every iteration the target intensities are interpolated, nothing else
+- the residuals are saturated as by PhotometricCostFunction::lossFunction,
+but the Hessian is not reweighted, otherwise it would not be constant
+- the points which leave the image or enter the margins are excluded
+by subtracting their terms from the Hessian
+- the motion prior is not supported
+*/
+
+#pragma once
+
+#include "std.h"
+#include "eigen.h"
+#include "ocv.h"
+#include "ceres.h"
+
+#include "geometry/geometry.h"
+#include "projection/generic_camera.h"
+#include "localization/local_cost_functions.h"
+
+class InverseCompositionalAlignment
+{
+public:
+    // gradU1 and gradV1 are the reference gradients at the scale of dataPack,
+    // scale is the corresponding image scale
+    InverseCompositionalAlignment(const ICamera * camera, const Transf & xiBaseCam,
+            const PhotometricPack & dataPack,
+            const Mat32f & gradU1, const Mat32f & gradV1, double scale);
+
+    virtual ~InverseCompositionalAlignment()
+    {
+        delete _camera;
+        _camera = NULL;
+    }
+
+    // owns the camera clone
+    InverseCompositionalAlignment(const InverseCompositionalAlignment &) = delete;
+    InverseCompositionalAlignment & operator = (const InverseCompositionalAlignment &) = delete;
+
+    // T12 is the motion of the odometry frame, as in PhotometricCostFunction
+    // maxTime is in seconds, 0 means no limit
+    PoseSolverSummary align(Transf & T12, const Mat32f & img2, double maxTime = 0) const;
+
+    void setMaxIterations(int val) { _maxIterations = val; }
+
+    const Matrix6d & hessian() const { return _hessian; }
+
+private:
+    // returns the cost, Jtr and the Hessian of the excluded points are accumulated
+    double accumulate(const Transf & xi21, const Grid2D<float> & imageGrid,
+            Vector6d & Jtr, Matrix6d & excludedHessian) const;
+
+    bool inMargin(const Vector2d & pt, const Grid2D<float> & imageGrid) const;
+
+    // the same saturation as PhotometricCostFunction::lossFunction, with unit slope at 0
+    double saturate(const double x) const
+    {
+        return sign(x) * LOSS_FACTOR * (1. - exp(-abs(x) / LOSS_FACTOR));
+    }
+
+    ICamera * _camera;
+    const Transf _xiBaseCam;
+    const PhotometricPack & _dataPack;
+    Vector3dVec _xVec;  // reference points in the camera frame
+    mutable Vector3dVec _transformedPoints;  // _xVec in the camera frame 2, buffer of accumulate
+    Matrix<double, Dynamic, 6, RowMajor> _jacobian;
+    Matrix6d _hessian;
+    const double _invScale;
+    int _maxIterations;
+    const double LOSS_FACTOR = 3;
+    const double MARGIN_SIZE;
+    const double STEP_TOLERANCE = 1e-8;
+};
+
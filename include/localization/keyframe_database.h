@@ -0,0 +1,96 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Disk-backed keyframe storage
+
+The keyframes are appended to a binary file as they are added:
+    file header | record header, image | record header, image | ...
+- the image is stored raw, 8 bits per pixel
+- the poses are kept in memory, the images are read through a memory mapping
+of the file and only the maxResident most recently used ones are kept decoded
+- opening a file scans the record headers only, the records from the first
+truncated or inconsistent one (an interrupted write) are dropped
+Not thread-safe, the images are shallow copies which stay valid after the eviction.
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+#include "std.h"
+#include "eigen.h"
+#include "ocv.h"
+
+#include "geometry/geometry.h"
+
+class KeyframeDatabase
+{
+public:
+    KeyframeDatabase(int maxResident = 32);
+    
+    ~KeyframeDatabase() { close(); }
+    
+    // owns the file descriptor and the mapping
+    KeyframeDatabase(const KeyframeDatabase &) = delete;
+    KeyframeDatabase & operator = (const KeyframeDatabase &) = delete;
+    
+    // maps the keyframes stored in the file, creates the file if it does not exist,
+    // returns false if the file cannot be opened or is not a keyframe database
+    bool open(const string & fileName);
+    
+    void close();
+    
+    bool isOpen() const { return _fd != -1; }
+    
+    int size() const { return _entryVec.size(); }
+    
+    // writes the keyframe to the file, returns its index
+    int add(const Mat8u & img, const Transf & xi);
+    
+    const Transf & pose(int idx) const { return _entryVec[idx].xi; }
+    
+    Mat8u image(int idx);
+    
+    void setMaxResident(int val);
+    
+private:
+    struct Entry
+    {
+        Transf xi;
+        size_t offset;  // of the image data
+        int rows, cols;
+    };
+    
+    // the data of the file at offset, the mapping is extended to the end of the file if needed
+    const uint8_t * fileData(size_t offset, size_t length);
+    
+    void touch(int idx, const Mat8u & img);
+    
+    vector<Entry> _entryVec;
+    
+    // the decoded images, the most recently used first
+    list<pair<int, Mat8u>> _residentList;
+    std::unordered_map<int, list<pair<int, Mat8u>>::iterator> _residentMap;
+    int _maxResident;
+    
+    int _fd;
+    uint8_t * _mapPtr;
+    size_t _mapSize;
+    size_t _fileSize;
+};
+
@@ -0,0 +1,74 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Spatial index over the keyframe positions
+
+A hashed uniform grid of cubic cells, the insertion is O(1)
+and a query visits only the cells overlapping the search region.
+The orientation is not indexed, it is left to the caller's filter.
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+#include "std.h"
+#include "eigen.h"
+
+class KeyframeIndex
+{
+public:
+    // the radius of typical queries is a good cell size
+    KeyframeIndex(double cellSize);
+    
+    void insert(int idx, const Vector3d & position);
+    
+    void clear();
+    
+    int size() const { return _positionVec.size(); }
+    
+    // the indices of the points within radius from center, unordered
+    vector<int> radiusSearch(const Vector3d & center, double radius) const;
+    
+    // at most k indices of the closest points, the closest first
+    vector<int> nearest(const Vector3d & center, int k) const;
+    
+private:
+    typedef int64_t CellKey;
+    
+    // 21 bits per coordinate
+    CellKey cellKey(int x, int y, int z) const
+    {
+        const CellKey MASK = (1 << 21) - 1;
+        return ((x & MASK) << 42) | ((y & MASK) << 21) | (z & MASK);
+    }
+    
+    int cellCoord(double x) const { return int(floor(x * _invCellSize)); }
+    
+    // appends the (squared distance, index) of the points of the cell
+    void visitCell(int x, int y, int z, const Vector3d & center,
+            vector<pair<double, int>> & distVec) const;
+    
+    const double _cellSize;
+    const double _invCellSize;
+    std::unordered_map<CellKey, vector<int>> _cellMap;
+    // the positions by the order of insertion, the point indices are stored in _indexVec
+    Vector3dVec _positionVec;
+    vector<int> _indexVec;
+};
+
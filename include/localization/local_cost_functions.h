@@ -28,7 +28,10 @@ Cost functions for localization based on photometric data and mutual information
 
 #include "geometry/geometry.h"
 #include "projection/generic_camera.h"
+#include "localization/pose_solver.h"
 
+template<typename Camera>
+class CameraModelJacobian;
 
 
 // to store the data for the photometric optimization
@@ -46,8 +49,9 @@ works faster than autodiff version and works with any ICamera
 
 - 3D points in the dataPack must be projected into the odometry base frame
 - the computed transformation will correspond the the motion of the odometry frame
+- as a NormalEquationTerm it is used by PoseSolver without storing the jacobian
 */
-struct PhotometricCostFunction : ceres::CostFunction
+struct PhotometricCostFunction : ceres::CostFunction, NormalEquationTerm
 {
 
     PhotometricCostFunction(const ICamera * camera, const Transf & xiBaseCam,
@@ -61,6 +65,28 @@ struct PhotometricCostFunction : ceres::CostFunction
     }
     
     virtual bool Evaluate(double const * const * parameters, double * residual, double ** jacobian) const;
+    
+    // the body of Evaluate, instantiated for ICamera and for CameraModels
+    template<typename Camera>
+    bool evaluate(const Camera & camera, double const * const * parameters,
+            double * residual, double ** jacobian) const;
+    
+    virtual double accumulateNormalEquations(const double * pose,
+            Matrix6d & JtJ, Vector6d & Jtr) const;
+    
+    virtual double computeCost(const double * pose) const;
+    
+    // the points are processed in parallel blocks, JtJ and Jtr are NULL to compute the cost only
+    template<typename Camera>
+    double accumulate(const Camera & camera, const double * pose,
+            Matrix6d * JtJ, Vector6d * Jtr) const;
+    
+    // residuals and row-major jacobian rows of the points [begin, end),
+    // jacobian is NULL to compute the residuals only
+    template<typename Camera>
+    void evaluateRange(const Camera & camera, const CameraModelJacobian<Camera> & jacobianCalculator,
+            const Vector3dVec & transformedPoints, const int begin, const int end,
+            double * residual, double * jacobian) const;
 
     void lossFunction(const double x, double & rho, double & drhodx) const;
     
@@ -72,6 +98,8 @@ struct PhotometricCostFunction : ceres::CostFunction
     const PhotometricPack & _dataPack;
     const Grid2D<float> _imageGrid;
     
+    // point cloud in frame 2 for evaluate and accumulate, which are therefore not reentrant
+    mutable Vector3dVec _transformedPoints;
     
 //    const double _scale;
     const double _invScale;
@@ -79,6 +107,44 @@ struct PhotometricCostFunction : ceres::CostFunction
     const double MARGIN_SIZE;
 };
 
+/*
+PhotometricCostFunction with the camera model known at compile time.
+Camera must be one of the final camera classes, so that the projection
+and its Jacobian are inlined into the point loop instead of being virtual calls.
+It is created by makePhotometricCostFunction, which instantiates it for CameraModels
+*/
+template<typename Camera>
+struct ModelPhotometricCostFunction : PhotometricCostFunction
+{
+    ModelPhotometricCostFunction(const Camera * camera, const Transf & xiBaseCam,
+            const PhotometricPack & dataPack,
+            const Mat32f & img2, double scale) :
+            PhotometricCostFunction(camera, xiBaseCam, dataPack, img2, scale) {}
+    
+    virtual bool Evaluate(double const * const * parameters, double * residual, double ** jacobian) const
+    {
+        // _camera is a clone, so it has the same type as the constructor argument
+        return evaluate(static_cast<const Camera &>(*_camera), parameters, residual, jacobian);
+    }
+    
+    virtual double accumulateNormalEquations(const double * pose,
+            Matrix6d & JtJ, Vector6d & Jtr) const
+    {
+        return accumulate(static_cast<const Camera &>(*_camera), pose, &JtJ, &Jtr);
+    }
+    
+    virtual double computeCost(const double * pose) const
+    {
+        return accumulate(static_cast<const Camera &>(*_camera), pose, NULL, NULL);
+    }
+};
+
+// chooses the ModelPhotometricCostFunction by the type of camera,
+// falls back to the generic PhotometricCostFunction for unknown models
+PhotometricCostFunction * makePhotometricCostFunction(const ICamera * camera,
+        const Transf & xiBaseCam, const PhotometricPack & dataPack,
+        const Mat32f & img2, double scale);
+
 
 /*
 This struct is ment for the automatic differentiation by ceres-solver.
@@ -22,6 +22,7 @@ SLAM system
 #pragma once
 
 #include "std.h"
+#include "except.h"
 #include "eigen.h"
 #include "ocv.h"
 
@@ -34,6 +35,11 @@ SLAM system
 #include "reconstruction/eucm_sgm.h"
 #include "localization/sparse_odom.h"
 #include "localization/photometric.h"
+#include "localization/motion_model.h"
+#include "localization/frame_features.h"
+#include "localization/keyframe_index.h"
+#include "localization/keyframe_database.h"
+#include "utils/parallel.h"
 
 struct MappingParameters
 {
@@ -48,8 +54,20 @@ struct MappingParameters
             else if (pname == "min_stereo_base") minStereoBase = item.second.get_value<double>();
             else if (pname == "dist_thresh") maxDistance = item.second.get_value<double>();
             else if (pname == "normalize_scale") normalizeScale = item.second.get_value<bool>();
+            else if (pname == "max_photometric_points") maxPhotometricPoints = item.second.get_value<int>();
+            else if (pname == "motion_prediction") motionPrediction = item.second.get_value<bool>();
+            else if (pname == "prediction_depth") predictionDepth = item.second.get_value<double>();
+            else if (pname == "convergence_radius") convergenceRadius = item.second.get_value<double>();
+            else if (pname == "relocalization_candidates") relocalizationCandidates = item.second.get_value<int>();
+            else if (pname == "relocalization_time_budget") relocalizationTimeBudget = item.second.get_value<double>();
+            else if (pname == "candidate_cancel_margin") candidateCancelMargin = item.second.get_value<double>();
+            else if (pname == "keyframe_database") keyframeDatabase = item.second.get_value<string>();
+            else if (pname == "resident_keyframes") residentKeyframes = item.second.get_value<int>();
+        }
+        if (not (convergenceRadius > 0))
+        {
+            throw runtime_error("MappingParameters : convergence_radius must be positive");
         }
-        
     }
     
     MappingParameters() {}
@@ -66,16 +84,44 @@ struct MappingParameters
     //beyond this distance the points are not used for the localization
     double maxDistance = 5;
     bool normalizeScale = true;
+    
+    //the upper bound on the number of points of the photometric localization, 0 means no limit
+    int maxPhotometricPoints = 0;
+    
+    //the initial guess of the photometric localization fuses the odometry
+    //with a constant-velocity model, the coarse scales are skipped if it is accurate
+    bool motionPrediction = true;
+    
+    //typical depth of the scene, to convert the translation uncertainty into pixels
+    double predictionDepth = 2;
+    
+    //the pixel error which the photometric alignment corrects at any scale
+    double convergenceRadius = 2;
+    
+    //the number of keyframes the inter frame is localized against concurrently,
+    //the one with the lowest final cost is kept
+    int relocalizationCandidates = 1;
+    
+    //the time of the localization against a candidate, in seconds, 0 means no limit
+    double relocalizationTimeBudget = 0;
+    
+    //a candidate is cancelled if its cost at some scale exceeds the best one
+    //by this fraction of the best cost
+    double candidateCancelMargin = 0.1;
+    
+    //if not empty, the keyframes are stored in this file and loaded from it at the start,
+    //only residentKeyframes images are kept in memory
+    string keyframeDatabase;
+    int residentKeyframes = 32;
 };
 
 
 struct Frame
 {
-    Mat8u img;
+    Mat8u img; //empty if the keyframes are stored in the database
     Transf xi; //the position is defined in the global frame
 };
 
-//Speed estimation and extrapolation are to be added
 //Assumed that the data arrives in the chronological order
 
 
@@ -91,21 +137,35 @@ public:
     
     void feedImage(const Mat8u & img);
     
-    void pushInterFrame(const Mat8u & img);
+    void pushInterFrame(const FrameFeatures & features);
     
     void reInit(const Transf & xi);
     
     int selectMapFrame(const Transf & xi, const double K = 4); //-1 means that there is no matching frame
     
-    Transf localizeMI(); //localizes the inter frame wrt _frameVec[_mapIdx]
-    Transf localizePhoto(const Mat8u & img); //localizes the image wrt interFrame
+    //at most maxNumber matching frames, the closest first
+    vector<int> selectMapFrames(const Transf & xi, const int maxNumber, const double K = 4);
+    
+    //appends a keyframe to _frameVec, _frameIndex and the database if it is open
+    void pushMapFrame(const Mat8u & img, const Transf & xi);
+    
+    //from _frameVec or the database
+    Mat8u mapFrameImage(const int idx);
+    
+    //localizes the inter frame wrt _frameVec[_mapIdx] and the other candidates,
+    //_mapIdx is set to the best one; features are those of the inter frame
+    Transf localizeMI(const FrameFeatures & features);
+    Transf localizePhoto(const FrameFeatures & features); //localizes the image wrt interFrame
     
     Transf getCameraMotion(const Transf & xi) const;
     
     bool checkDistance(const Transf & xi, const double K = 1.) const;
     bool checkDistance(const Transf & xi1, const Transf & xi2, const double K = 1.) const;
     
-    void improveStereo(const Mat8u & img);
+    void improveStereo(const FrameFeatures & features);
+    
+    //the coarsest scale at which the predicted pixel error is within the convergence radius
+    int predictionScale(const MotionPrediction & prediction) const;
 //private:
 
     enum State {MAP_BEGIN, MAP_INIT, MAP_LOCALIZE, MAP_SLAM};
@@ -124,9 +184,13 @@ public:
     bool _odomInit;
     Frame _interFrame;
     vector<Frame> _frameVec;
+    KeyframeIndex _frameIndex; //over the positions of _frameVec
+    KeyframeDatabase _frameDatabase; //the images of _frameVec if it is open
     DepthMap _depth;
+    bool _depthChanged; //_depth is newer than the one of _localizer
     Transf _xiLocal; //current base pose estimation in the local frame
     Transf _xiLocalOld; //for VO scale rectification
+    Transf _xiLocalPrev; //the estimation at the previous image, for the motion model
     Transf _xiOdom; //the last odometry measure
     Transf _zetaOdom; //the last odometry measure
     Transf _xiOdomImage; //the last odometry before the last image
@@ -144,6 +208,13 @@ public:
     MotionStereo _motionStereo;
     
     ScalePhotometric _localizer;
+    
+    //predicts the motion between the images
+    MotionModel _motionModel;
+    
+    //runs the localizations against the candidates of localizeMI,
+    //the threads are kept between the calls
+    WorkerPool _candidatePool;
 };
 
 
@@ -0,0 +1,75 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Motion prediction for the photometric localization
+
+A constant-velocity model on the estimated frame-to-frame increments
+is fused with the wheel odometry increment:
+- the increments are those of the base frame, expressed in the previous base frame,
+so they do not depend on the choice of the local frame
+- both sources are treated as independent with diagonal covariances
+over (tx, ty, tz, rx, ry, rz), and fused component-wise by the inverse variance
+- the odometry uncertainty grows with the traveled distance and rotation,
+as in OdometryPrior
+- the constant-velocity uncertainty is a running mean of the squared change
+between successive increments, that is the unmodeled acceleration
+*/
+
+#pragma once
+
+#include "std.h"
+#include "eigen.h"
+
+#include "geometry/geometry.h"
+
+struct MotionPrediction
+{
+    Transf zeta;  // predicted increment
+    Vector6d sigma;  // standard deviation of the increment components
+};
+
+class MotionModel
+{
+public:
+    // errV and errW are the relative odometry errors, 
+    // sigmaT and sigmaR are the error floors in meters and radians
+    MotionModel(double errV = 0.03, double errW = 0.03,
+            double sigmaT = 0.005, double sigmaR = 0.005);
+    
+    // forgets the velocity, to be called when the motion is discontinuous
+    void reset();
+    
+    MotionPrediction predict(const Transf & zetaOdom) const;
+    
+    // zeta is the estimated increment between the last two images
+    void update(const Transf & zeta);
+    
+    bool isInitialized() const { return _numUpdates > 0; }
+    
+private:
+    Vector6d odometryVariance(const Transf & zetaOdom) const;
+    
+    Vector6d _velocity;  // the last increment as (trans, rot)
+    Vector6d _accelerationVar;  // running mean of the squared increment change
+    int _numUpdates;
+    
+    const double _errV, _errW;
+    const double _sigmaT, _sigmaR;
+    const double ACCELERATION_DECAY = 0.3;  // weight of the newest increment change
+};
+
@@ -28,11 +28,36 @@ Relative camera pose estimation based on photometric error and depth map
 
 #include "reconstruction/depth_map.h"
 #include "localization/scale_space.h"
+#include "localization/frame_features.h"
 #include "geometry/geometry.h"
 #include "projection/generic_camera.h"
 #include "localization/local_cost_functions.h"
 #include "localization/cost_function_mi.h"
+#include "localization/inverse_compositional.h"
+#include "timer.h"
+
+#include <functional>
+#include <memory>
 //TODO add assertions ???
+// scales of the photometric localization used by the odometry and the mapping
+const int NUM_SCALES = 5;
+
+// statistics of ScalePhotometric::computePose and computePoseMI
+struct PoseEstimationSummary
+{
+    bool converged = true;  // every processed scale has converged
+    bool deadlineReached = false;  // the time budget has cut the optimization
+    bool cancelled = false;  // stopped by the scale callback
+    int processedScales = 0;
+    int iterations = 0;  // over all the scales
+    double finalCost = 0;  // at the last processed scale
+    // finalCost without the odometry prior, set by computePoseMI;
+    // the prior is centred on the initial guess, so only this part is comparable
+    // between the localizations which start from different guesses
+    double dataCost = 0;
+    double elapsedTime = 0;  // in seconds
+};
+
 class ScalePhotometric
 {
 public:
@@ -42,7 +67,12 @@ public:
             camPtr2(cam2->clone()),
             _xiBaseCam(0, 0, 0, 0, 0, 0),
             verbosity(0),
-            useMotionPrior(true) {}
+            useMotionPrior(true),
+            useDirectSolver(true),
+            useInverseCompositional(false),
+            maxPointNumber(0),
+            coarsestScale(-1),
+            _sparseDepthValid(false) {}
             
            
     virtual ~ScalePhotometric()
@@ -51,26 +81,89 @@ public:
         camPtr2 = NULL;
     }
     
-    void setXiBaseCam(const Transf & xiBaseCam) { _xiBaseCam = xiBaseCam; }
+    void setXiBaseCam(const Transf & xiBaseCam)
+    {
+        _xiBaseCam = xiBaseCam;
+        invalidatePhotometricData();
+    }
     void setNumberScales(int numScales)
     {
         scaleSpace1.setNumberScales(numScales);
         scaleSpace2.setNumberScales(numScales);
+        invalidatePhotometricData();
     }
     
     const DepthMap & depth() const { return depthMap; }
-    DepthMap & depth() { return depthMap; }
-    void setDepth(const DepthMap & newDepth) { depthMap = newDepth; }
+    // the caller may modify the depth map, so the cached data is dropped
+    DepthMap & depth()
+    {
+        invalidatePhotometricData();
+        _sparseDepthValid = false;
+        return depthMap; 
+    }
+    void setDepth(const DepthMap & newDepth)
+    {
+        depthMap = newDepth;
+        invalidatePhotometricData();
+        _sparseDepthValid = false;
+    }
     
     void setBaseImage(const Mat8u & img1);
     void setTargetImage(const Mat8u & img2);
+    // the pyramid of the features is shared if it has the same number of scales
+    void setBaseImage(const FrameFeatures & features1);
+    void setTargetImage(const FrameFeatures & features2);
+    // builds the photometric data of all the scales in advance
+    void buildPhotometricData();
+    // takes the base image and the photometric data from source, the data is shared, not copied;
+    // source must have called buildPhotometricData, then several objects may take it at once;
+    // the depth map is not taken, setDepth drops the shared data
+    void setBaseData(const ScalePhotometric & source);
     void setMotionPriorStatus(const bool val);
+    // PoseSolver instead of ceres::Problem in computePose, ceres is kept as a fallback
+    void setDirectSolverStatus(const bool val) { useDirectSolver = val; }
+    // InverseCompositionalAlignment in computePose, the motion prior is ignored
+    void setInverseCompositionalStatus(const bool val) { useInverseCompositional = val; }
+    // the upper bound on the number of points per scale, 0 means no limit
+    void setMaxPointNumber(const int val)
+    {
+        maxPointNumber = val;
+        invalidatePhotometricData();
+    }
+    // computePose starts at this scale instead of the coarsest one,
+    // to be used when the initial guess is accurate; -1 means all the scales
+    void setCoarsestScale(const int val) { coarsestScale = val; }
     Transf computePose(const Transf & T12);
+    // the odometry prior is centred on xiPrior instead of the initial guess T12,
+    // e.g. when the guess comes from a motion model and the prior from the odometry
+    Transf computePose(const Transf & T12, const Transf & xiPrior);
+    
+    // anytime versions: the remaining time is shared between the remaining scales
+    // in proportion to their pixel counts, the scales which do not fit into timeBudget (in seconds) are skipped,
+    // the best pose found so far is returned; timeBudget <= 0 means no limit
+    Transf computePose(const Transf & T12, double timeBudget, PoseEstimationSummary & summary);
+    Transf computePose(const Transf & T12, const Transf & xiPrior, double timeBudget,
+            PoseEstimationSummary & summary);
+    Transf computePoseMI(const Transf & T12, double timeBudget, PoseEstimationSummary & summary);
     
     void setVerbosity(int newVerbosity) { verbosity = newVerbosity; }
     
     Transf computePoseMI(const Transf & T12);
     Transf computePoseMI(const Transf & T12, const Transf & Todom);
+    
+    // gets the scale index and the data cost after every scale,
+    // the optimization stops if it returns false; timeBudget as in the anytime versions
+    typedef std::function<bool(int, double)> ScaleCallback;
+    Transf computePoseMI(const Transf & T12, const Transf & Todom, double timeBudget,
+            const ScaleCallback & callback, PoseEstimationSummary & summary);
+    
+    // the same, one scale at a time, for the callers which compare several localizations
+    // at every scale: startPoseMI resets summary and centres the prior on T12,
+    // then stepPoseMI is called from scaleSpace1.size() - 1 down to 0 and updates T12;
+    // it returns false if timeBudget is exhausted
+    void startPoseMI(const Transf & T12, PoseEstimationSummary & summary);
+    bool stepPoseMI(int scaleIdx, Transf & T12, const Transf & Todom, double timeBudget,
+            PoseEstimationSummary & summary);
     //TODO make enum for choosing the camera
     array<double, 6> covarianceEigenValues(const int scaleIdx, 
             const Transf T12, bool baseValues);
@@ -79,25 +172,66 @@ public:
     void wrapImage(const Mat8u & src, Mat8u & dst, const Transf T12) const;
 private:
     // scaleSpace2 must be initialized
-    void computePose(int scaleIdx, Transf & T12);
+    // maxTime is in seconds, 0 means no limit; the statistics are added to summary
+    void computePose(int scaleIdx, Transf & T12, double maxTime, PoseEstimationSummary & summary);
     void computePoseAuto(int scaleIdx, Transf & T12);
-    void computePoseMI(int scaleIdx, Transf & T12);
+    void computePoseMI(int scaleIdx, Transf & T12, double maxTime, PoseEstimationSummary & summary);
+    
+    // the first scale of computePose according to coarsestScale
+    int firstScale() const;
+    
+    // the time for the scale scaleIdx, the scales below it remain to be processed;
+    // -1 if the budget is exhausted
+    double scaleTimeBudget(double elapsedTime, double timeBudget, int scaleIdx,
+            PoseEstimationSummary & summary) const;
     //TODO optimize, not to recompute the odometry covariance at every step
     //Mey be implement a separate function localOdometryCovariance(Todom) or a structure
-    void computePoseMI(int scaleIdx, Transf & T12, const Transf & Todom);
+    void computePoseMI(int scaleIdx, Transf & T12, const Transf & Todom,
+            double maxTime, PoseEstimationSummary & summary);
     PhotometricPack initPhotometricData(int scaleIdx);
+    
+    // the packs depend only on the base image, the depth map and _xiBaseCam,
+    // they are built at the first request and reused by all the localizations
+    // until one of them changes; sets the active scale of scaleSpace1
+    const PhotometricPack & getPhotometricData(int scaleIdx);
+    void invalidatePhotometricData() { _packVec.clear(); }
+    
+    // reduces the candidates of initPhotometricData to maxPointNumber,
+    // the budget is shared evenly between the cells of a grid
+    // and the strongest gradients are kept in each cell
+    void subsampleCandidates(const int cols, const int rows);
 
     Transf _xiBaseCam;
     Transf _xiPrior;
     bool useMotionPrior;
+    bool useDirectSolver;
+    bool useInverseCompositional;
+    int maxPointNumber;
+    int coarsestScale;
     BinaryScalSpace scaleSpace1;
     BinaryScalSpace scaleSpace2;
     ICamera * camPtr2;
     DepthMap depthMap;
     
+    // buffers of initPhotometricData reused between the calls
+    Vector2dVec _candidatePointVec;
+    vector<int> _candidateIdxVec;
+    vector<double> _candidateGradVec;
+    vector<double> _candidateDepthVec;
+    
+    // the valid cells of depthMap, kept until the depth changes
+    SparseDepthMap _sparseDepth;
+    bool _sparseDepthValid;
+    
+    // cache of getPhotometricData, one pack per scale, NULL if not built yet;
+    // the packs may be shared with other objects by setBaseData
+    vector<std::shared_ptr<const PhotometricPack>> _packVec;
+    
     //TODO make a parameter structure
     // minimal squared norm of gradient for a pixel to be accepted
     const double GRAD_THRESH = 250;
+    // the cell size of subsampleCandidates, in pixels of the current scale
+    const int CELL_SIZE = 16;
     const double GRAD_MAX = 255;
     const double DIST_MAX = 50;
     int verbosity;
@@ -0,0 +1,104 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Levenberg-Marquardt solver for 6-DoF pose problems
+The terms accumulate the normal equations J^T J and J^T r directly,
+so the Jacobian of the whole problem is never stored
+*/
+
+#pragma once
+
+#include "std.h"
+#include "eigen.h"
+#include "ceres.h"
+
+#include "geometry/geometry.h"
+
+struct NormalEquationTerm
+{
+    virtual ~NormalEquationTerm() {}
+
+    // adds the term to JtJ and Jtr at the given pose,
+    // returns the cost 0.5 * |r|^2, as ceres does
+    virtual double accumulateNormalEquations(const double * pose,
+            Matrix6d & JtJ, Vector6d & Jtr) const = 0;
+
+    // the same cost without the derivatives
+    virtual double computeCost(const double * pose) const = 0;
+};
+
+/*
+Adapter for small cost functions with a single 6-parameter block, like OdometryPrior
+The Jacobian is computed densely with CostFunction::Evaluate
+The cost function is not owned
+*/
+class DenseNormalEquationTerm : public NormalEquationTerm
+{
+public:
+    DenseNormalEquationTerm(const ceres::CostFunction * costFunction);
+
+    virtual double accumulateNormalEquations(const double * pose,
+            Matrix6d & JtJ, Vector6d & Jtr) const;
+
+    virtual double computeCost(const double * pose) const;
+
+private:
+    const ceres::CostFunction * _costFunction;
+};
+
+struct PoseSolverOptions
+{
+    int maxIterations = 150;
+    double functionTolerance = 1e-6;  // relative decrease of the cost
+    double parameterTolerance = 1e-8;  // relative step size
+    double initialLambda = 1e-4;  // damping, relative to the diagonal of JtJ
+    double maxTime = 0;  // in seconds, 0 means no limit
+    bool verbose = false;
+};
+
+struct PoseSolverSummary
+{
+    double initialCost = 0;
+    double finalCost = 0;
+    int iterations = 0;
+    bool converged = false;
+    bool timeLimitReached = false;
+};
+
+/*
+The pose is the 6-vector (translation, angle-axis) and is updated additively,
+the same as a ceres parameter block without a local parametrization
+The terms are not owned
+*/
+class PoseSolver
+{
+public:
+    PoseSolver(const PoseSolverOptions & options = PoseSolverOptions()) : _options(options) {}
+
+    void addTerm(const NormalEquationTerm * term) { _termVec.push_back(term); }
+
+    PoseSolverSummary solve(double * pose) const;
+
+private:
+    double computeCost(const double * pose) const;
+    double accumulateNormalEquations(const double * pose, Matrix6d & JtJ, Vector6d & Jtr) const;
+
+    PoseSolverOptions _options;
+    vector<const NormalEquationTerm *> _termVec;
+};
+
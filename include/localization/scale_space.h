@@ -21,9 +21,16 @@ Scale space for multiscale optimization
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+
 #include "std.h"
+#include "eigen.h"
 #include "ocv.h"
 #include "io.h"
+#include "except.h"
+
+#include "utils/parallel.h"
 
 class BinaryScalSpace
 {
@@ -54,24 +61,34 @@ public:
         if (gradientOn) resizeGradient();
     }
     
+    // a copy of the scale space shares the matrices,
+    // so new ones are allocated instead of writing into the old ones
     void generate(const Mat8u & img)
     {
+        releaseBuffers();
         img.convertTo(imgVec[0], CV_32F);
         propagate();
     }
 
     void generate(const Mat32f & img)
     {
+        releaseBuffers();
         img.copyTo(imgVec[0]);
         propagate();
     }
 
     const Mat32f & get() const { return imgVec[activeScaleIdx]; }
-    const Mat32f & getGradU() const { return gradUVec[activeScaleIdx]; }
-    const Mat32f & getGradV() const { return gradVVec[activeScaleIdx]; }
+    
+    // the gradients are computed once at the first access to the level,
+    // the access may come from several threads
+    const Mat32f & getGradU() const { return gradientLevel(activeScaleIdx).gradU; }
+    
+    const Mat32f & getGradV() const { return gradientLevel(activeScaleIdx).gradV; }
     
     int size() const { return imgVec.size(); }
     
+    int pixelCount(int idx) const { return imgVec[idx].rows * imgVec[idx].cols; }
+    
     int scaleByIdx(int idx) const { return (1 << idx); }
     
     void setActiveScale(int idx) 
@@ -92,55 +109,71 @@ public:
     
 private:
 
+    // the gradients of a level, shared by the copies of the scale space like the images
+    struct GradientLevel
+    {
+        std::once_flag computed;
+        Mat32f gradU;
+        Mat32f gradV;
+    };
+    
+    // new levels, the copies keep the old ones
     void resizeGradient()
     {
-        gradUVec.resize(size());
-        gradVVec.resize(size());
+        gradVec.resize(size());
+        for (auto & x : gradVec) x = std::make_shared<GradientLevel>();
+    }
+    
+    void releaseBuffers()
+    {
+        for (auto & x : imgVec) x.release();
+        if (gradientOn) resizeGradient();
+    }
+    
+    const GradientLevel & gradientLevel(int idx) const
+    {
+        if (not gradientOn) throw runtime_error("BinaryScalSpace : the gradient is disabled");
+        GradientLevel & level = *gradVec[idx];
+        std::call_once(level.computed, [&]()
+        {
+            Sobel(imgVec[idx], level.gradU, CV_32F, 1, 0, 3, 1./8);
+            Sobel(imgVec[idx], level.gradV, CV_32F, 0, 1, 3, 1./8);
+        });
+        return level;
     }
     
     void propagate()
     {
-        if (gradientOn)
+        for (int i = 1; i < imgVec.size(); i++)
         {
-            Sobel(imgVec[0], gradUVec[0], CV_32F, 1, 0, 3, 1./8);
-            Sobel(imgVec[0], gradVVec[0], CV_32F, 0, 1, 3, 1./8);
+            downsample(imgVec[i - 1], imgVec[i]);
         }
-        for (int i = 1; i < imgVec.size(); i++)
+    }
+    
+    // 2x2 box filter: dst(v, u) is the mean of src(2v..2v+1, 2u..2u+1),
+    // an odd last row or column of src is dropped
+    static void downsample(const Mat32f & src, Mat32f & dst)
+    {
+        dst.create(Size(src.cols / 2, src.rows / 2));
+        const int W = dst.cols;
+        if (W == 0) return;
+        typedef Eigen::Map<const Eigen::ArrayXf> RowMap;
+        typedef Eigen::Map<const Eigen::ArrayXf, 0, Eigen::InnerStride<2>> PairMap;
+        parallelFor(0, dst.rows, 64, [&](const int begin, const int end)
         {
-            /*Mat32f blured;
-            GaussianBlur(imgVec[i - 1], blured, Size(3, 3), 0, 0);
-            imgVec[i].create(Size(blured.cols/2, blured.rows/2));
-            for (int v = 0; v < imgVec[i].rows; v++)
-            {
-                for (int u = 0; u < imgVec[i].cols; u++)
-                {
-                    imgVec[i](v, u) = blured(2*v, 2*u);
-                }
-            }*/
-            
-            imgVec[i].create(Size(imgVec[i - 1].cols/2, imgVec[i - 1].rows/2));
-            imgVec[i].setTo(0);
-            for (int v = 0; v < imgVec[i - 1].rows; v++)
+            Eigen::ArrayXf rowSum(2 * W);
+            for (int v = begin; v < end; v++)
             {
-                int vs = min((int)round(v / 2.), imgVec[i].rows - 1);
-                for (int u = 0; u < imgVec[i - 1].cols; u++)
-                {
-                    int us = min((int)round(u / 2), imgVec[i].cols - 1);
-                    imgVec[i](vs, us) += imgVec[i - 1](v, u);
-                }
+                // the vertical sum is vectorized, then the neighbor columns are added
+                rowSum = RowMap(&src(2 * v, 0), 2 * W) + RowMap(&src(2 * v + 1, 0), 2 * W);
+                Eigen::Map<Eigen::ArrayXf>(&dst(v, 0), W) =
+                        0.25f * (PairMap(rowSum.data(), W) + PairMap(rowSum.data() + 1, W));
             }
-            imgVec[i] *= 0.25;
-            if (gradientOn)
-            {
-                Sobel(imgVec[i], gradUVec[i], CV_32F, 1, 0, 3, 1./8);
-                Sobel(imgVec[i], gradVVec[i], CV_32F, 0, 1, 3, 1./8);
-            }
-        }
+        });
     }
     
     std::vector<Mat32f> imgVec;
-    std::vector<Mat32f> gradUVec;
-    std::vector<Mat32f> gradVVec;
+    std::vector<std::shared_ptr<GradientLevel>> gradVec;
     int scale;
     int activeScaleIdx;
     bool gradientOn;
@@ -28,6 +28,7 @@ Relative camera pose estimation based on photometric error and depth map
 
 #include "geometry/geometry.h"
 #include "projection/generic_camera.h"
+#include "localization/frame_features.h"
 
 //TODO make a parameter structure
 //const double MIN_INIT_DIST = 0.25;   // minimal distance traveled befor VO is used
@@ -52,6 +53,8 @@ public:
     ~SparseOdometry() { delete camera; }
     
     void feedData(const Mat8u & imageNew, const Transf xiOdomNew);
+    // the corner response is taken from the features
+    void feedData(const FrameFeatures & features, const Transf xiOdomNew);
     
       
     double computeTransfSparse(const Vector3dVec & xVec1, const Vector3dVec & xVec2, 
@@ -74,6 +77,8 @@ public:
     
 private:
     
+    void feedData(const Mat8u & imageNew, const Mat32f & cornerResp, const Transf xiOdomNew);
+    
     //TODO TEST
     Vector2dVec keypointVec1;
     Vector2dVec keypointVec2;
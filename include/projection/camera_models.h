@@ -0,0 +1,59 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Dispatch on the camera model
+The classes templated by the camera model are created through newCameraModel,
+which is the only place where the list of the models is enumerated.
+*/
+
+#pragma once
+
+#include <typeinfo>
+
+#include "projection/generic_camera.h"
+#include "projection/eucm.h"
+#include "projection/mei.h"
+#include "projection/ucm.h"
+#include "projection/pinhole.h"
+
+template<typename... Cameras>
+struct CameraModelList {};
+
+// the models which get the specialized classes, all of them are final
+typedef CameraModelList<EnhancedCamera, MeiCamera, UnifiedCamera, Pinhole> CameraModels;
+
+template<typename Base, template<typename> class Model, typename... Args>
+Base * newCameraModel(CameraModelList<>, const ICamera * camera, const Args & ... args)
+{
+    return NULL;
+}
+
+// new Model<Camera>(camera, args...) where Camera is the type of camera,
+// NULL if the type is not in the list
+template<typename Base, template<typename> class Model,
+        typename Camera, typename... Others, typename... Args>
+Base * newCameraModel(CameraModelList<Camera, Others...>, const ICamera * camera,
+        const Args & ... args)
+{
+    // the models are final, so the exact type identifies them
+    if (typeid(*camera) == typeid(Camera))
+    {
+        return new Model<Camera>(static_cast<const Camera *>(camera), args...);
+    }
+    return newCameraModel<Base, Model>(CameraModelList<Others...>(), camera, args...);
+}
@@ -65,7 +65,7 @@ struct EnhancedProjector
     static const int INTRINSIC_COUNT = 6;
 };
 
-class EnhancedCamera : public ICamera
+class EnhancedCamera final : public ICamera
 {
 public:
     using ICamera::params;
@@ -112,7 +112,62 @@ public:
         return projector(params.data(), src.data(), dst.data()); 
     }
     
+    virtual bool reconstructPointArray(const ArrayX2d & src, ArrayX3d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & alpha = params[0];
+        const double & beta = params[1];
+        const double & fu = params[2];
+        const double & fv = params[3];
+        const double & u0 = params[4];
+        const double & v0 = params[5];
+        
+        dst.resize(src.rows(), 3);
+        dst.col(0) = (src.col(0) - u0) / fu;
+        dst.col(1) = (src.col(1) - v0) / fv;
+        
+        const ArrayXd u2 = dst.col(0).square() + dst.col(1).square();
+        const double gamma = 1. - alpha;
+        const ArrayXd det = 1 - (alpha - gamma)*beta*u2;
+        dst.col(2) = (1. - u2 * alpha * alpha * beta) / (gamma + alpha * det.max(0.).sqrt());
+        return fillMask(det >= 0, maskVec);
+    }
+    
+    virtual bool projectPointArray(const ArrayX3d & src, ArrayX2d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & alpha = params[0];
+        const double & beta = params[1];
+        const double & fu = params[2];
+        const double & fv = params[3];
+        const double & u0 = params[4];
+        const double & v0 = params[5];
+        
+        const ArrayXd denom = alpha * (src.col(2).square() 
+                + beta * (src.col(0).square() + src.col(1).square())).sqrt()
+                + (1. - alpha) * src.col(2);
+        const ArrayXd denomInv = 1. / denom;
+        dst.resize(src.rows(), 2);
+        dst.col(0) = fu * src.col(0) * denomInv + u0;
+        dst.col(1) = fv * src.col(1) * denomInv + v0;
+        
+        // the same tests as in EnhancedProjector
+        if (alpha > 0.5)
+        {
+            const double C = (alpha - 1.) / (alpha + alpha - 1.);
+            return fillMask((denom >= 1e-3) and (src.col(2) * denomInv >= C), maskVec);
+        }
+        return fillMask(denom >= 1e-3, maskVec);
+    }
+    
     virtual bool projectionJacobian(const Vector3d & src, double * dudx, double * dvdx) const
+    {
+        Vector2d pt;
+        return projectWithJacobian(src, pt, dudx, dvdx);
+    }
+    
+    virtual bool projectWithJacobian(const Vector3d & src, Vector2d & dst,
+            double * dudx, double * dvdx) const
     {
         const double & alpha = params[0];
         const double & beta = params[1];
@@ -150,7 +205,10 @@ public:
          
         }
         
-        double k = 1. / eta / eta;
+        double etainv = 1. / eta;
+        dst << fu * x * etainv + u0, fv * y * etainv + v0;
+        
+        double k = etainv * etainv;
         double abrho = alpha * beta / rho;
         double Jxy = k * abrho * x * y;
         double Jz = k * (gamma + alpha * z / rho);
@@ -46,6 +46,20 @@ public:
     virtual bool projectionJacobian(const Vector3d & src,
             double * dudx, double * dvdx) const {return false;}
     
+    /// projects the point and computes the projection Jacobian in one pass
+    /// the Jacobian is zero if the point is not projected
+    virtual bool projectWithJacobian(const Vector3d & src, Vector2d & dst,
+            double * dudx, double * dvdx) const
+    {
+        const bool res = projectPoint(src, dst);
+        if (not res or not projectionJacobian(src, dudx, dvdx))
+        {
+            fill(dudx, dudx + 3, 0.);
+            fill(dvdx, dvdx + 3, 0.);
+        }
+        return res;
+    }
+    
     //MEMORY IS SUPPOSED TO BE ALLOCATED
     virtual bool intrinsicJacobian(const Vector3d & src,
             double * dudalpha, double * dvdalpha) const {return false;}
@@ -61,56 +75,119 @@ public:
     
     virtual ICamera * clone() const = 0; 
     
-    bool reconstructPointCloud(const Vector2dVec & src, Vector3dVec & dst) const
+    /*
+    Batch reconstruction and projection over structure-of-arrays data
+    the columns of the arrays are (u, v) and (x, y, z)
+    maskVec gets one byte per point, 1 if the point is reconstructed/projected
+    returns true if all the points are valid
+    The default implementations call reconstructPoint/projectPoint,
+    the camera models override them with vectorized kernels
+    */
+    virtual bool reconstructPointArray(const ArrayX2d & src, ArrayX3d & dst,
+            std::vector<uint8_t> & maskVec) const
     {
-        dst.resize(src.size());
+        dst.resize(src.rows(), 3);
+        maskVec.resize(src.rows());
         bool res = true;
-        for (int i = 0; i < src.size(); i++)
+        for (int i = 0; i < src.rows(); i++)
         {
-            res &= reconstructPoint(src[i], dst[i]);
-        }  
+            Vector3d X;
+            maskVec[i] = reconstructPoint(Vector2d(src(i, 0), src(i, 1)), X);
+            dst.row(i) = X.transpose();
+            res &= maskVec[i];
+        }
         return res;
     }
     
-    bool reconstructPointCloud(const Vector2dVec & src,
-            Vector3dVec & dst, std::vector<bool> & maskVec) const
+    virtual bool projectPointArray(const ArrayX3d & src, ArrayX2d & dst,
+            std::vector<uint8_t> & maskVec) const
     {
-        dst.resize(src.size());
-        maskVec.resize(src.size());
+        dst.resize(src.rows(), 2);
+        maskVec.resize(src.rows());
         bool res = true;
-        for (int i = 0; i < src.size(); i++)
+        for (int i = 0; i < src.rows(); i++)
         {
-            maskVec[i] = reconstructPoint(src[i], dst[i]);
+            Vector2d pt;
+            maskVec[i] = projectPoint(Vector3d(src(i, 0), src(i, 1), src(i, 2)), pt);
+            dst.row(i) = pt.transpose();
             res &= maskVec[i];
-        }  
+        }
         return res;
     }
     
-    bool projectPointCloud(const Vector3dVec & src, Vector2dVec & dst) const
+    // the point clouds are converted to arrays and processed by the batch functions
+    bool reconstructPointCloud(const Vector2dVec & src, Vector3dVec & dst) const
     {
-        dst.resize(src.size());
-        bool res = true;
-        for (int i = 0; i < src.size(); i++)
-        {
-            res &= projectPoint(src[i], dst[i]);
-        }  
+        std::vector<uint8_t> maskVec;
+        return reconstructPointCloud(src, dst, maskVec);
+    }
+    
+    bool reconstructPointCloud(const Vector2dVec & src,
+            Vector3dVec & dst, std::vector<bool> & maskVec) const
+    {
+        std::vector<uint8_t> byteMaskVec;
+        bool res = reconstructPointCloud(src, dst, byteMaskVec);
+        maskVec.assign(byteMaskVec.begin(), byteMaskVec.end());
+        return res;
+    }
+    
+    bool reconstructPointCloud(const Vector2dVec & src,
+            Vector3dVec & dst, std::vector<uint8_t> & maskVec) const
+    {
+        ArrayX2d srcArr;
+        ArrayX3d dstArr;
+        toArray(src, srcArr);
+        bool res = reconstructPointArray(srcArr, dstArr, maskVec);
+        fromArray(dstArr, dst);
         return res;
     }
     
+    bool projectPointCloud(const Vector3dVec & src, Vector2dVec & dst) const
+    {
+        std::vector<uint8_t> maskVec;
+        return projectPointCloud(src, dst, maskVec);
+    }
+    
     bool projectPointCloud(const Vector3dVec & src,
             Vector2dVec & dst, std::vector<bool> & maskVec) const
     {
-        dst.resize(src.size());
-        maskVec.resize(src.size());
-        bool res = true;
-        for (int i = 0; i < src.size(); i++)
-        {
-            maskVec[i] = projectPoint(src[i], dst[i]);
-            res &= maskVec[i];
-        }  
+        std::vector<uint8_t> byteMaskVec;
+        bool res = projectPointCloud(src, dst, byteMaskVec);
+        maskVec.assign(byteMaskVec.begin(), byteMaskVec.end());
+        return res;
+    }
+    
+    bool projectPointCloud(const Vector3dVec & src,
+            Vector2dVec & dst, std::vector<uint8_t> & maskVec) const
+    {
+        ArrayX3d srcArr;
+        ArrayX2d dstArr;
+        toArray(src, srcArr);
+        bool res = projectPointArray(srcArr, dstArr, maskVec);
+        fromArray(dstArr, dst);
         return res;
     }
     
+    // conversions between the vectors of points and the arrays, Eigen vectors are packed
+    template<int N>
+    static void toArray(const std::vector<Matrix<double, N, 1>> & src, 
+            Eigen::Array<double, Dynamic, N> & dst)
+    {
+        if (src.empty()) dst.resize(0, N);
+        else dst = Map<const Matrix<double, N, Dynamic>>(src[0].data(), N, src.size()).transpose().array();
+    }
+    
+    template<int N>
+    static void fromArray(const Eigen::Array<double, Dynamic, N> & src,
+            std::vector<Matrix<double, N, 1>> & dst)
+    {
+        dst.resize(src.rows());
+        if (not dst.empty())
+        {
+            Map<Matrix<double, N, Dynamic>>(dst[0].data(), N, dst.size()) = src.matrix().transpose();
+        }
+    }
+    
     const double * getParams() const { return params.data(); }
     
     int numParams() const { return params.size(); }
@@ -119,6 +196,15 @@ public:
     virtual double upperBound(int idx) const { return 1e4; }
     
 protected:
+    // writes a boolean array into a byte mask, true if all the values are true
+    template<typename Derived>
+    static bool fillMask(const Eigen::ArrayBase<Derived> & isValid, std::vector<uint8_t> & maskVec)
+    {
+        maskVec.resize(isValid.size());
+        Map<Eigen::Array<uint8_t, Dynamic, 1>>(maskVec.data(), maskVec.size()) = isValid.template cast<uint8_t>();
+        return isValid.all();
+    }
+    
     std::vector<double> params;
 };
 
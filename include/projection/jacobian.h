@@ -47,12 +47,18 @@ L_uTheta =  [ R21      0        ]
             [  0   R21*M_uTheta ]
             
 V = L_uTheta * dxi/dt
+
+The class is parametrized on the camera model, so that projectionJacobian
+can be inlined when the camera type is known at compile time.
+The camera is not copied and must outlive the object.
+The methods are const, one object can be shared between threads.
 */
-class CameraJacobian
+template<typename Camera>
+class CameraModelJacobian
 {
 public:
-    CameraJacobian(const ICamera * camera, const Transf & T12, const Transf & T23) :
-        _camera(camera->clone()),
+    CameraModelJacobian(const Camera * camera, const Transf & T12, const Transf & T23) :
+        _camera(*camera),
         twoTransforms(true)
     {
         Matrix3d R21 = T12.rotMatInv();
@@ -63,8 +69,8 @@ public:
         L12 = -R32 * hat(T23.trans()) * R21 * M;
     }
     
-    CameraJacobian(const ICamera * camera, const Transf & T12) :
-        _camera(camera->clone()),
+    CameraModelJacobian(const Camera * camera, const Transf & T12) :
+        _camera(*camera),
         L11( T12.rotMatInv() ),
         L12( Matrix3d::Zero()),
         L22( L11 * interOmegaRot(T12.rot()) ),
@@ -73,16 +79,21 @@ public:
         
     
     // Point jacobian
-    void dpdxi(const Vector3d & X2, double * dudxi, double * dvdxi)
+    void dpdxi(const Vector3d & X2, double * dudxi, double * dvdxi) const
     {
         Matrix23drm projJac;
-        if (not _camera->projectionJacobian(X2, projJac.data(), projJac.data() + 3))
+        if (not _camera.projectionJacobian(X2, projJac.data(), projJac.data() + 3))
         {
             fill(dudxi, dudxi + 6, 0.);
             fill(dvdxi, dvdxi + 6, 0.);
             return;
         }
-        
+        dpdxi(X2, projJac, dudxi, dvdxi);
+    }
+    
+    // Point jacobian with dp/dX given by ICamera::projectWithJacobian
+    void dpdxi(const Vector3d & X2, const Matrix23drm & projJac, double * dudxi, double * dvdxi) const
+    {
         Map<Covector3d> dudtr(dudxi);
         Map<Covector3d> dudrot(dudxi + 3);
         Matrix3d B = twoTransforms ? Matrix3d(hat(X2) * L22 - L12) : Matrix3d(hat(X2) * L22);
@@ -95,16 +106,20 @@ public:
     }
     
     //brightness jacobian
-    void dfdxi(const Vector3d & X2, const Covector2d & grad, double * dfdxi)
+    void dfdxi(const Vector3d & X2, const Covector2d & grad, double * dfdxi) const
     {
         Matrix23drm projJac;
-        if (not _camera->projectionJacobian(X2, projJac.data(), projJac.data() + 3))
+        if (not _camera.projectionJacobian(X2, projJac.data(), projJac.data() + 3))
         {
             fill(dfdxi, dfdxi + 6, 0.);
             return;
         }
-        Covector3d dfdX = grad * projJac;
-        
+        this->dfdxi(X2, Covector3d(grad * projJac), dfdxi);
+    }
+    
+    //brightness jacobian with dfdX = grad(img) * dp/dX already computed
+    void dfdxi(const Vector3d & X2, const Covector3d & dfdX, double * dfdxi) const
+    {
         Map<Covector3d> dfdtr(dfdxi);
         Map<Covector3d> dfdrot(dfdxi + 3);
         Matrix3d B = twoTransforms ? Matrix3d(hat(X2) * L22 - L12) : Matrix3d(hat(X2) * L22);
@@ -113,11 +128,13 @@ public:
     }
     
 private:
-    ICamera * _camera;
+    const Camera & _camera;
     Matrix3d L11, L12, L22;
     bool twoTransforms;
 };
 
+typedef CameraModelJacobian<ICamera> CameraJacobian;
+
 
 const bool JAC_DIRECT = false;
 const bool JAC_INVERTED = true;
@@ -138,6 +155,10 @@ class InterJacobian
 public:
     InterJacobian(const ICamera * camera,
             const Transf & xi13, const Transf & xi23, bool inverted) :
+    InterJacobian(camera, Pose<double>(xi13), xi23, inverted) {}
+    
+    InterJacobian(const ICamera * camera,
+            const Pose<double> & xi13, const Transf & xi23, bool inverted) :
     _camera(camera->clone()),
     R12( xi13.rotMat() * xi23.rotMatInv() ),
     t13( xi13.trans() ),
@@ -0,0 +1,193 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+A camera decorator which stores the back-projected rays of the pixel grid
+NOTE:
+- reconstructPoint at integer (u, v) returns exactly the ray of the wrapped model
+- between the pixels the rays are interpolated bilinearly;
+the interpolation error is at most (|d2X/du2| + |d2X/dv2|) / 8 per component,
+getMaxError gives the largest angle measured at the centers of the pixel cells,
+where the bilinear interpolation error of a smooth function is maximal
+- points outside the image or next to non-reconstructible pixels
+are passed to the wrapped model, as well as all the projection functions
+- the table is shared between the clones and is rebuilt by setParameters
+*/
+
+#pragma once
+
+#include <memory>
+
+#include "std.h"
+#include "eigen.h"
+
+#include "projection/generic_camera.h"
+
+class LookupCamera final : public ICamera
+{
+public:
+    using ICamera::params;
+    using ICamera::width;
+    using ICamera::height;
+
+    LookupCamera(const ICamera * camera) :
+            ICamera(camera->width, camera->height, camera->numParams()),
+            _camera(camera->clone())
+    {
+        ICamera::setParameters(camera->getParams());
+        _table = std::make_shared<const RayTable>(_camera.get());
+    }
+
+    LookupCamera(const LookupCamera & other) :
+            ICamera(other.width, other.height, other.numParams()),
+            _camera(other._camera->clone()),
+            _table(other._table)
+    {
+        ICamera::setParameters(other.getParams());
+    }
+
+    virtual ~LookupCamera() {}
+
+    virtual bool reconstructPoint(const Vector2d & src, Vector3d & dst) const
+    {
+        const double & u = src[0];
+        const double & v = src[1];
+        if (u < 0 or v < 0 or u > width - 1 or v > height - 1)
+        {
+            return _camera->reconstructPoint(src, dst);
+        }
+        const int u0 = u;
+        const int v0 = v;
+        const double du = u - u0;
+        const double dv = v - v0;
+        const int idx = u0 + v0 * width;
+        if (du == 0 and dv == 0)
+        {
+            if (not _table->maskVec[idx]) return false;
+            dst = _table->rayVec[idx];
+            return true;
+        }
+        // the last row and column have no right or bottom neighbor, du or dv is 0 there
+        const int idx10 = du == 0 ? idx : idx + 1;
+        const int idx01 = dv == 0 ? idx : idx + width;
+        const int idx11 = dv == 0 ? idx10 : idx10 + width;
+        if (not (_table->maskVec[idx] and _table->maskVec[idx10]
+                and _table->maskVec[idx01] and _table->maskVec[idx11]))
+        {
+            return _camera->reconstructPoint(src, dst);
+        }
+        dst = (1 - dv) * ((1 - du) * _table->rayVec[idx] + du * _table->rayVec[idx10])
+                + dv * ((1 - du) * _table->rayVec[idx01] + du * _table->rayVec[idx11]);
+        return true;
+    }
+
+    virtual bool projectPoint(const Vector3d & src, Vector2d & dst) const
+    {
+        return _camera->projectPoint(src, dst);
+    }
+
+    virtual bool projectPointArray(const ArrayX3d & src, ArrayX2d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        return _camera->projectPointArray(src, dst, maskVec);
+    }
+
+    virtual bool projectionJacobian(const Vector3d & src, double * dudx, double * dvdx) const
+    {
+        return _camera->projectionJacobian(src, dudx, dvdx);
+    }
+
+    virtual bool projectWithJacobian(const Vector3d & src, Vector2d & dst,
+            double * dudx, double * dvdx) const
+    {
+        return _camera->projectWithJacobian(src, dst, dudx, dvdx);
+    }
+
+    virtual bool intrinsicJacobian(const Vector3d & src,
+            double * dudalpha, double * dvdalpha) const
+    {
+        return _camera->intrinsicJacobian(src, dudalpha, dvdalpha);
+    }
+
+    virtual double getCenterU() { return _camera->getCenterU(); }
+
+    virtual double getCenterV() { return _camera->getCenterV(); }
+
+    virtual void setParameters(const double * const newParams)
+    {
+        ICamera::setParameters(newParams);
+        _camera->setParameters(newParams);
+        _table = std::make_shared<const RayTable>(_camera.get());
+    }
+
+    virtual double lowerBound(int idx) const { return _camera->lowerBound(idx); }
+    virtual double upperBound(int idx) const { return _camera->upperBound(idx); }
+
+    virtual LookupCamera * clone() const { return new LookupCamera(*this); }
+
+    // the largest angle in radians between an interpolated ray and the exact one
+    double getMaxError() const { return _table->maxError; }
+
+    const ICamera * getCamera() const { return _camera.get(); }
+
+private:
+    // the rays are stored as returned by the model, not normalized
+    struct RayTable
+    {
+        RayTable(const ICamera * camera) :
+                rayVec(camera->width * camera->height),
+                maskVec(camera->width * camera->height, 0),
+                maxError(0)
+        {
+            const int W = camera->width;
+            const int H = camera->height;
+            for (int v = 0; v < H; v++)
+            {
+                for (int u = 0; u < W; u++)
+                {
+                    const int idx = u + v * W;
+                    maskVec[idx] = camera->reconstructPoint(Vector2d(u, v), rayVec[idx]);
+                    if (not maskVec[idx]) rayVec[idx].setZero();
+                }
+            }
+
+            for (int v = 0; v < H - 1; v++)
+            {
+                for (int u = 0; u < W - 1; u++)
+                {
+                    const int idx = u + v * W;
+                    if (not (maskVec[idx] and maskVec[idx + 1]
+                            and maskVec[idx + W] and maskVec[idx + W + 1])) continue;
+                    Vector3d X;
+                    if (not camera->reconstructPoint(Vector2d(u + 0.5, v + 0.5), X)) continue;
+                    const Vector3d Xint = 0.25 * (rayVec[idx] + rayVec[idx + 1]
+                            + rayVec[idx + W] + rayVec[idx + W + 1]);
+                    const double err = atan2(X.cross(Xint).norm(), X.dot(Xint));
+                    maxError = max(maxError, err);
+                }
+            }
+        }
+
+        Vector3dVec rayVec;
+        vector<uint8_t> maskVec;
+        double maxError;
+    };
+
+    std::unique_ptr<ICamera> _camera;
+    std::shared_ptr<const RayTable> _table;
+};
+
@@ -70,7 +70,7 @@ struct MeiProjector
     static const int INTRINSIC_COUNT = 10;
 };
 
-class MeiCamera : public ICamera
+class MeiCamera final : public ICamera
 {
 public:
     using ICamera::params;
@@ -118,7 +118,66 @@ public:
         return projector(params.data(), src.data(), dst.data());
     }
     
+    virtual bool reconstructPointArray(const ArrayX2d & src, ArrayX3d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & xi = params[0];
+        const double & fu = params[6];
+        const double & fv = params[7];
+        const double & u0 = params[8];
+        const double & v0 = params[9];
+        
+        dst.resize(src.rows(), 3);
+        dst.col(0) = (src.col(0) - u0) / fu;
+        dst.col(1) = (src.col(1) - v0) / fv;
+        
+        const ArrayXd u2 = dst.col(0).square() + dst.col(1).square();
+        const ArrayXd gamma = (1. + u2*(1 - xi*xi)).sqrt();
+        const ArrayXd etanum = -gamma - xi*u2;
+        const ArrayXd etadenom = xi*xi*u2 - 1;
+        dst.col(2) = etadenom / (etadenom + xi*etanum);
+        maskVec.assign(src.rows(), 1);
+        return true;
+    }
+    
+    virtual bool projectPointArray(const ArrayX3d & src, ArrayX2d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & xi = params[0];
+        const double & k1 = params[1];
+        const double & k2 = params[2];
+        const double & k3 = params[3];
+        const double & k4 = params[4];
+        const double & k5 = params[5];
+        const double & fu = params[6];
+        const double & fv = params[7];
+        const double & u0 = params[8];
+        const double & v0 = params[9];
+        
+        const ArrayXd rho = (src.col(0).square() + src.col(1).square() + src.col(2).square()).sqrt();
+        const ArrayXd denominv = 1. / (src.col(2) + xi*rho);
+        const ArrayXd xn = src.col(0) * denominv;
+        const ArrayXd yn = src.col(1) * denominv;
+        
+        // the same distortion as in MeiProjector
+        const ArrayXd xx = xn*xn, xy = xn*yn, yy = yn*yn;
+        const ArrayXd r2 = xx + yy;
+        const ArrayXd D = 1. + k1*r2 + k2*r2*r2 + k3*r2*r2*r2;
+        dst.resize(src.rows(), 2);
+        dst.col(0) = fu * (xn*D + 2.*k4*xy + k5*(r2 + 2.*xx)) + u0;
+        dst.col(1) = fv * (yn*D + 2.*k5*xy + k4*(r2 + 2.*yy)) + v0;
+        maskVec.assign(src.rows(), 1);
+        return true;
+    }
+    
     virtual bool projectionJacobian(const Vector3d & src, double * dudx, double * dvdx) const
+    {
+        Vector2d pt;
+        return projectWithJacobian(src, pt, dudx, dvdx);
+    }
+    
+    virtual bool projectWithJacobian(const Vector3d & src, Vector2d & dst,
+            double * dudx, double * dvdx) const
     {
         const double & xi = params[0];
         const double & k1 = params[1];
@@ -164,11 +223,9 @@ public:
         double r2 = yn * yn + xn * xn;
         double D = 1. + k1*r2 + k2*r2*r2 + k3*r2*r2*r2;
         
-//        double deltax = 2.*k4*xyn + k5*(r2 + 2.*xxn);
-//        double deltay = 2.*k5*xyn + k4*(r2 + 2.*yyn);
-//        
-//        double xd = xn * D + deltax;
-//        double yd = yn * D + deltay;
+        double deltax = 2.*k4*xyn + k5*(r2 + 2.*xxn);
+        double deltay = 2.*k5*xyn + k4*(r2 + 2.*yyn);
+        dst << fu * (xn*D + deltax) + u0, fv * (yn*D + deltay) + v0;
 
         double dDdr2 = k1 + 2*k2*r2 + 3*k3*r2*r2; // dD/d(r^2)
         // d(r^2)/dx = 2x
@@ -25,7 +25,7 @@ The Pinhole Camera Model
 
 #include "projection/generic_camera.h"
 
-class Pinhole : public ICamera
+class Pinhole final : public ICamera
 {
 public:
 
@@ -67,6 +67,34 @@ public:
         return true;
     }
 
+    virtual bool reconstructPointArray(const ArrayX2d & src, ArrayX3d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & u0 = params[0];
+        const double & v0 = params[1];
+        const double & f = params[2];
+        dst.resize(src.rows(), 3);
+        dst.col(0) = (src.col(0) - u0) / f;
+        dst.col(1) = (src.col(1) - v0) / f;
+        dst.col(2) = 1;
+        maskVec.assign(src.rows(), 1);
+        return true;
+    }
+    
+    virtual bool projectPointArray(const ArrayX3d & src, ArrayX2d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & u0 = params[0];
+        const double & v0 = params[1];
+        const double & f = params[2];
+        const auto isProjected = src.col(2) >= 1e-2;
+        const ArrayXd fzInv = f / src.col(2);
+        dst.resize(src.rows(), 2);
+        dst.col(0) = isProjected.select(src.col(0) * fzInv + u0, -1.);
+        dst.col(1) = isProjected.select(src.col(1) * fzInv + v0, -1.);
+        return fillMask(isProjected, maskVec);
+    }
+    
     //TODO implement the projection and distortion Jacobian
     virtual bool projectionJacobian(const Vector3d & src, double * dudx, double * dvdx) const
     {
@@ -83,6 +111,19 @@ public:
         dvdx[0] = 0;
         dvdx[1] = f/z;
         dvdx[2] = -y * f/ zz;
+        return true;
+    }
+    
+    virtual bool projectWithJacobian(const Vector3d & src, Vector2d & dst,
+            double * dudx, double * dvdx) const
+    {
+        if (not projectPoint(src, dst))
+        {
+            fill(dudx, dudx + 3, 0.);
+            fill(dvdx, dvdx + 3, 0.);
+            return false;
+        }
+        return projectionJacobian(src, dudx, dvdx);
     }
     
     virtual Pinhole * clone() const
@@ -61,7 +61,7 @@ struct UnifiedProjector
     static const int INTRINSIC_COUNT = 5;
 };
 
-class UnifiedCamera : public ICamera
+class UnifiedCamera final : public ICamera
 {
 public:
     using ICamera::params;
@@ -109,7 +109,54 @@ public:
         return projector(params.data(), src.data(), dst.data()); 
     }
     
+    virtual bool reconstructPointArray(const ArrayX2d & src, ArrayX3d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & xi = params[0];
+        const double & fu = params[1];
+        const double & fv = params[2];
+        const double & u0 = params[3];
+        const double & v0 = params[4];
+        
+        dst.resize(src.rows(), 3);
+        dst.col(0) = (src.col(0) - u0) / fu;
+        dst.col(1) = (src.col(1) - v0) / fv;
+        
+        const ArrayXd u2 = dst.col(0).square() + dst.col(1).square();
+        const ArrayXd gamma = (1. + u2*(1 - xi*xi)).sqrt();
+        const ArrayXd etanum = -gamma - xi*u2;
+        const ArrayXd etadenom = xi*xi*u2 - 1;
+        dst.col(2) = etadenom / (etadenom + xi*etanum);
+        maskVec.assign(src.rows(), 1);
+        return true;
+    }
+    
+    virtual bool projectPointArray(const ArrayX3d & src, ArrayX2d & dst,
+            std::vector<uint8_t> & maskVec) const
+    {
+        const double & xi = params[0];
+        const double & fu = params[1];
+        const double & fv = params[2];
+        const double & u0 = params[3];
+        const double & v0 = params[4];
+        
+        const ArrayXd rho = (src.col(0).square() + src.col(1).square() + src.col(2).square()).sqrt();
+        const ArrayXd denominv = 1. / (src.col(2) + xi*rho);
+        dst.resize(src.rows(), 2);
+        dst.col(0) = fu * src.col(0) * denominv + u0;
+        dst.col(1) = fv * src.col(1) * denominv + v0;
+        maskVec.assign(src.rows(), 1);
+        return true;
+    }
+    
     virtual bool projectionJacobian(const Vector3d & src, double * dudx, double * dvdx) const
+    {
+        Vector2d pt;
+        return projectWithJacobian(src, pt, dudx, dvdx);
+    }
+    
+    virtual bool projectWithJacobian(const Vector3d & src, Vector2d & dst,
+            double * dudx, double * dvdx) const
     {
         const double & xi = params[0];
         const double & fu = params[1];
@@ -144,6 +191,7 @@ public:
         dvdX(1) = (xi*rho + z - xi*yy*rhoinv) * deninv2;
         dvdX(2) = -y * (1 + xi*z*rhoinv) * deninv2;
         
+        dst << fu * xn + u0, fv * yn + v0;
         Map<Covector3d>((double *)dudx) = fu * dudX;
         Map<Covector3d>((double *)dvdx) = fv * dvdX;
         return true;
@@ -0,0 +1,75 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Table of unit bearing vectors for every cell of a depth map grid
+NOTE:
+(u, v) is an image point
+(x, y) is a depth map point
+
+The tables are shared: all the depth maps which have the same camera
+and the same scale parameters use the same table.
+It is built once, on the first request, and never modified after that,
+so it can be read from several threads at once.
+A depth map builds its table on the first use and holds it.
+The last few requested tables are also kept by the registry, so that
+short-lived maps do not rebuild them.
+*/
+
+#pragma once
+
+#include <memory>
+
+#include "std.h"
+#include "eigen.h"
+
+#include "projection/generic_camera.h"
+#include "reconstruction/scale_parameters.h"
+
+class BearingTable
+{
+public:
+    using Ptr = std::shared_ptr<const BearingTable>;
+
+    // returns the table corresponding to the camera and the depth grid,
+    // builds it if it does not exist yet; thread-safe
+    static Ptr get(const ICamera * camera, const ScaleParameters & params);
+
+    // (x, y) are the depth coordinates, the bearing is normalized
+    const Vector3d & at(const int x, const int y) const { return _bearingVec[x + y*_xMax]; }
+    const Vector3d & at(const int idx) const { return _bearingVec[idx]; }
+
+    // false if the cell center could not be reconstructed by the camera
+    bool isValid(const int x, const int y) const { return _maskVec[x + y*_xMax]; }
+    bool isValid(const int idx) const { return _maskVec[idx]; }
+
+    // true if the image point (u, v) is exactly the center of a cell,
+    // in which case idx is set to the cell index
+    bool cellIndex(const Vector2d & pt, int & idx) const;
+
+    int size() const { return _bearingVec.size(); }
+
+    // must not be called directly, use BearingTable::get
+    BearingTable(const ICamera * camera, const ScaleParameters & params);
+
+private:
+    const ScaleParameters _params;
+    const int _xMax;
+    Vector3dVec _bearingVec;
+    vector<uint8_t> _maskVec;
+};
+
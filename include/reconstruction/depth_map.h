@@ -31,7 +31,9 @@ NOTE:
 
 #include "projection/generic_camera.h"
 #include "reconstruction/scale_parameters.h"
+#include "reconstruction/bearing_table.h"
 #include "reconstruction/mh_pack.h"
+#include "reconstruction/sparse_depth_map.h"
 #include "reconstruction/stereo_misc.h"
 
 
@@ -45,7 +47,10 @@ enum ReconstructionFlags : uint32_t
     DEFAULT_VALUES = 16,
     SIGMA_VALUE = 32,
     QUERY_INDICES = 64,  //  stronger than QUERY_POINTS
-    INDEX_MAPPING = 128    
+    INDEX_MAPPING = 128,
+    HYPOTHESIS_INDICES = 256,
+    IMAGE_POINTS = 512,
+    COST_VALUE = 1024
 };
 
 // Performs a filtered merge on the input depths and sigmas
@@ -66,7 +71,8 @@ public:
             sigmaVec(depth.sigmaVec),
             costVec(depth.costVec),
             hMax(depth.hMax),
-            hStep(depth.hStep) {}
+            hStep(depth.hStep),
+            bearingTable(std::atomic_load(&depth.bearingTable)) {}
 
     //basic constructor for multi-hypothesis
     DepthMap(const ICamera * camera, const ScaleParameters & params, const int hMax = 1):
@@ -78,6 +84,10 @@ public:
             hMax(hMax),
             hStep(xMax*yMax) {}
 
+    // dense form of a sparse map, the missing cells are OUT_OF_RANGE
+    // the costs are set to DEFAULT_COST_DEPTH
+    DepthMap(const ICamera * camera, const SparseDepthMap & sparse, const int hMax = 1);
+
     virtual ~DepthMap() 
     {
         if (cameraPtr != NULL)
@@ -101,6 +111,7 @@ public:
             costVec = other.costVec;
             hMax = other.hMax;
             hStep = other.hStep;
+            bearingTable = std::atomic_load(&other.bearingTable);
         }
         return *this;
     }
@@ -179,6 +190,16 @@ public:
     //TODO overload instead of default args
     vector<int> getIdxVec(const Vector2dVec & queryPointVec = Vector2dVec()) const;
     
+    // writes the valid cells of the first hypothesis into sparse,
+    // its storage is reused
+    void toSparse(SparseDepthMap & sparse) const;
+    
+    // unit bearing vector of an image point, taken from the bearing table if pt is a cell center
+    bool reconstructBearing(const Vector2d & pt, Vector3d & X) const
+    {
+        return reconstructBearing(getBearingTable(), pt, X);
+    }
+    
     //TODO - Depecrated
     void reconstructUncertainty(std::vector<int> & idxVec, 
             Vector3dVec & minDistVec,
@@ -193,11 +214,17 @@ public:
             std::vector<int> & idxVec, Vector3dVec & result) const;
 
     // Reconstructs 2d points into corresponding 3d pointcloud
-    // result.idxVec corresponds to indices of points in original queryPointVec
-    // To use QUERY_POINT, insert the query point vector into result.idxVec. Do not
-    //   use ALL_HYPOTHESES with QUERY_POINT.
+    // Only the reconstructed points are kept, all the output vectors have the same length
+    // result.idxVec and result.cloud are always filled, the other fields only on demand:
+    //   INDEX_MAPPING -> idxMapVec, indices of points in the original query
+    //   IMAGE_POINTS -> imagePointVec, HYPOTHESIS_INDICES -> hypIdxVec
+    //   SIGMA_VALUE -> sigmaVec, COST_VALUE -> costVec
+    // The unrequested fields are emptied. The storage of the pack is reused, so 
+    //   passing the same pack to consecutive calls avoids reallocations
+    // To use QUERY_INDICES, insert the query index vector into result.idxVec
+    // To use QUERY_POINTS, insert the query point vector into result.imagePointVec.
     // To use IMAGE_VALUES, insert the value vector into result.valVec. This should
-    //   only be used along with QUERY_POINT
+    //   only be used along with QUERY_POINTS
     void reconstruct(MHPack & result, const uint32_t reconstFlags = 0 ) const;
     
     //TODO make it bool and make it return a mask
@@ -230,6 +257,9 @@ public:
     void wrapDepth(const DepthMap& dMap1, const DepthMap& dMap2,
             const Transformation<double> T12, DepthMap& output) const;
 
+    // Forward-warps the first hypothesis layer into the frame T12, 
+    // the closest point is kept when several of them fall into the same cell
+    // The output has the same camera and scale parameters
     DepthMap wrapDepth(const Transformation<double> T12) const;
 
     // Filters all hypotheses to remove noise, using either a median filter or 
@@ -245,6 +275,12 @@ public:
     bool empty() { return valVec.size() == 0; }
 private:
 
+    // the bearing table of the map, built on the first call; NULL if there is no camera
+    BearingTable::Ptr getBearingTable() const;
+
+    // unit bearing vector of an image point, taken from the table if pt is a cell center
+    bool reconstructBearing(const BearingTable::Ptr & table, const Vector2d & pt, Vector3d & X) const;
+
     void pixelMedianFilter(const int x, const int y, const int h, DepthMap & dst);
     void pixelAverageFilter(const Vector3iVec & matches, DepthMap & dst);
 
@@ -264,4 +300,12 @@ private:
     int hStep; // Step to get to the next hypothesis
     
     ICamera * cameraPtr;
+    
+    // set by getBearingTable and held for the lifetime of the map,
+    // accessed atomically since const methods may run concurrently
+    mutable BearingTable::Ptr bearingTable;
+    
+    // ping-pong buffers of filterNoise, not copied with the map
+    std::vector<double> filterDepthBuf;
+    std::vector<double> filterSigmaBuf;
 };
@@ -66,10 +66,31 @@ public:
     }    
     
     //TODO figure out how to treat the mask efficiently
+    // the image is shared, not copied, so the caller must not modify it in place
     void setBaseImage(const Mat8u & image)
     {
-        image.copyTo(_img1);
-        computeMask();
+        Mat8u gradAbs8u;
+        computeGradientMagnitude(image, gradAbs8u);
+        setBaseImage(image, gradAbs8u);
+    }
+    
+    // gradMagnitude is the output of computeGradientMagnitude for image,
+    // computed once and shared with the other consumers of the frame
+    void setBaseImage(const Mat8u & image, const Mat8u & gradMagnitude)
+    {
+        _img1 = image;
+        computeMask(gradMagnitude);
+    }
+    
+    // |du| + |dv| with the central difference, blurred with a 7x7 Gaussian
+    static void computeGradientMagnitude(const Mat8u & img, Mat8u & dst)
+    {
+        Mat16s gradx, grady;
+        Sobel(img, gradx, CV_16S, 1, 0, 1);
+        Sobel(img, grady, CV_16S, 0, 1, 1);
+        Mat16s gradAbs = abs(gradx) + abs(grady);
+        GaussianBlur(gradAbs, gradAbs, Size(7, 7), 0, 0);
+        gradAbs.convertTo(dst, CV_8U);
     }
        
     /*
@@ -107,16 +128,9 @@ public:
     
 private:
     
-    // based on the image gradient
-    void computeMask()
+    // based on the smoothed image gradient magnitude
+    void computeMask(const Mat8u & gradAbs8u)
     {
-        Mat16s gradx, grady;
-        Sobel(_img1, gradx, CV_16S, 1, 0, 1);
-        Sobel(_img1, grady, CV_16S, 0, 1, 1);
-        Mat16s gradAbs = abs(gradx) + abs(grady);
-        GaussianBlur(gradAbs, gradAbs, Size(7, 7), 0, 0);
-        Mat8u gradAbs8u;
-        gradAbs.convertTo(gradAbs8u, CV_8U);
         threshold(gradAbs8u, _maskMat, _params.gradientThresh, 128, CV_THRESH_BINARY);
     }
    
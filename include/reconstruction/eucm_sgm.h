@@ -51,6 +51,7 @@ struct SgmParameters : public StereoParameters
             else if (pname == "image_based_cost")       imageBasedCost = item.second.get_value<bool>();
             else if (pname == "salient_points_only")    salientPoints = item.second.get_value<bool>();
             else if (pname == "use_uv_cache")           useUVCache = item.second.get_value<bool>();
+            else if (pname == "use_depth_cache")        useDepthCache = item.second.get_value<bool>();
         }
     }
     
@@ -67,6 +68,10 @@ struct SgmParameters : public StereoParameters
     
     //precompute all the epipolar curves
     bool useUVCache = true;
+    
+    //precompute the depth and sigma for every pixel, disparity and descriptor step
+    //takes 8 * xMax * yMax * (dispMax + 1) * scaleVec.size() bytes
+    bool useDepthCache = false;
 };
 
 //TODO revamp, take MotionStereo as a model
@@ -86,6 +91,7 @@ public:
         computeRotated();
         computePinf();
         if (params.useUVCache) computeUVCache();
+        if (params.useDepthCache) computeDepthCache();
     }
     
     virtual ~EnhancedSgm()
@@ -95,6 +101,10 @@ public:
     // precompute coordinates for different disparities to speedup the computation
     void computeUVCache();
     
+    // precompute the triangulation results for all the disparities and steps,
+    // valid as long as the cameras and the transformation are fixed
+    void computeDepthCache();
+    
     // An interface function
     void computeStereo(const Mat8u & img1, const Mat8u & img2, DepthMap & depthMap);
     
@@ -128,6 +138,10 @@ public:
     
     //TODO rewrite
     void reconstructDepth(DepthMap & depth) const;
+    
+    // the points on the second image which delimit the disparity and the step
+    void getEpipolarPoints(const int x, const int y, const int disparity, const int step,
+            int & u21, int & v21, int & u22, int & v22) const;
     //// MISCELLANEOUS
     
     // index of an object in a linear array corresponding to pixel [row, col] 
@@ -161,6 +175,10 @@ private:
     
     const int DISPARITY_MARGIN = 20;
     Mat32s _uCache, _vCache;
+    
+    // depth and sigma for each pixel, step index and disparity + 1 (disparity -1 included)
+    Mat32f _depthCache, _sigmaCache;
+    vector<int> _stepIdxVec;  // the index of a step in scaleVec, -1 if absent
     Mat8u _errorBuffer;
     Mat8u _costBuffer; //TODO maybe merge with salientBuffer
     Mat8u _salientBuffer; 
@@ -15,6 +15,11 @@ struct MHPack
     Vector3dVec cloud; // Cloud points - exact data specified by datatype flag
     std::vector<double> valVec; // Image values at each position
 
+    // Scratch storage for the query of DepthMap::reconstruct
+    // Kept in the pack so that repeated reconstructions do not reallocate
+    std::vector<int> queryIdxVec;
+    Vector2dVec queryPointVec;
+
     enum Data // TODO - Fix or remove this, as this is no longer necessary except for specifying MIXMAX
     {
     	NO_DATA,
@@ -31,6 +36,7 @@ struct MHPack
 
     // Copy constructor
     MHPack(const MHPack & other) :
+        idxMapVec(other.idxMapVec),
         idxVec(other.idxVec),
         imagePointVec(other.imagePointVec),
         hypIdxVec(other.hypIdxVec),
@@ -0,0 +1,84 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Sparse form of the first hypothesis layer of a DepthMap
+Only the valid cells (depth >= MIN_DEPTH) are stored,
+their indices are sorted in the increasing order
+NOTE:
+(u, v) is an image point
+(x, y) is a depth map point
+
+The conversions are DepthMap::toSparse and the DepthMap constructor
+*/
+
+#pragma once
+
+#include "std.h"
+
+#include "reconstruction/scale_parameters.h"
+
+class SparseDepthMap : public ScaleParameters
+{
+public:
+    SparseDepthMap() {}
+    SparseDepthMap(const ScaleParameters & params) : ScaleParameters(params) {}
+
+    int size() const { return idxVec.size(); }
+    bool empty() const { return idxVec.empty(); }
+
+    // the data of the i-th valid cell
+    int index(const int i) const { return idxVec[i]; }
+    int x(const int i) const { return idxVec[i] % xMax; }
+    int y(const int i) const { return idxVec[i] / xMax; }
+    double depth(const int i) const { return valVec[i]; }
+    double sigma(const int i) const { return sigmaVec[i]; }
+
+    // the position of the cell idx among the valid cells, -1 if the cell is not valid
+    int find(const int idx) const
+    {
+        auto iter = std::lower_bound(idxVec.begin(), idxVec.end(), idx);
+        if (iter == idxVec.end() or *iter != idx) return -1;
+        return iter - idxVec.begin();
+    }
+
+    void clear()
+    {
+        idxVec.clear();
+        valVec.clear();
+        sigmaVec.clear();
+    }
+
+    // cells must be pushed in the increasing order of idx
+    void push_back(const int idx, const double val, const double sigma)
+    {
+        assert(idxVec.empty() or idxVec.back() < idx);
+        idxVec.push_back(idx);
+        valVec.push_back(val);
+        sigmaVec.push_back(sigma);
+    }
+
+    const vector<int> & getIdxVec() const { return idxVec; }
+    const vector<double> & getValVec() const { return valVec; }
+    const vector<double> & getSigmaVec() const { return sigmaVec; }
+
+private:
+    vector<int> idxVec;
+    vector<double> valVec;
+    vector<double> sigmaVec;
+};
+
@@ -30,3 +30,6 @@ const double OUT_OF_RANGE = 0.0;
 const double SIGMA_COEFF = 1 / sqrt(12);
 
 
+
+// minimal number of rows processed by one thread in the depth map filters
+const int FILTER_BAND_HEIGHT = 16;
@@ -21,6 +21,7 @@ along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
 #include "eigen.h"
 #include "std.h"
 #include "geometry/geometry.h"
+#include "projection/generic_camera.h"
 
 
 // num / denom if denom is big enough
@@ -83,28 +84,30 @@ public:
         double * res1, double * res2 = NULL,
         double * jac1 = NULL, double * jac2 = NULL) const;
     
+    /*
+    Batched versions over structure-of-arrays data
+    the columns of pArr and qArr are x, y and z of the direction vectors,
+    the computation runs over whole columns and is vectorized by Eigen
+    res1, res2 hold one value per point, jac1, jac2 hold 6 values per point
+    the results are the same as those of the per-pair functions
+    */
+    void compute(const ArrayX3d & pArr, const ArrayX3d & qArr,
+        double * res1, double * res2 = NULL,
+        double * jac1 = NULL, double * jac2 = NULL) const;
+    
+    void computeRegular(const ArrayX3d & pArr, const ArrayX3d & qArr,
+        double * res1, double * res2 = NULL,
+        double * jac1 = NULL, double * jac2 = NULL) const;
+    
     void compute(const Vector3dVec & pVec, const Vector3dVec & qVec,
         double * res1, double * res2 = NULL,
         double * jac1 = NULL, double * jac2 = NULL) const
     {
         assert(pVec.size() == qVec.size());
-        assert(res1 != NULL or res2 != NULL);
-        if (jac1 != NULL)
-        {
-            assert(res1 != NULL);
-        }
-        if (jac2 != NULL)
-        {
-            assert(res2 != NULL);
-        }
-        for (int i = 0; i < pVec.size(); i++)
-        {
-            compute(pVec[i], qVec[i],
-                    res1 != NULL ? res1 + i : NULL,
-                    res2 != NULL ? res2 + i : NULL,
-                    jac1 != NULL ? jac1 + 6 * i : NULL,
-                    jac2 != NULL ? jac2 + 6 * i : NULL);
-        }
+        ArrayX3d pArr, qArr;
+        ICamera::toArray(pVec, pArr);
+        ICamera::toArray(qVec, qArr);
+        compute(pArr, qArr, res1, res2, jac1, jac2);
     }
     
     void computeRegular(const Vector3dVec & pVec, const Vector3dVec & qVec,
@@ -112,23 +115,10 @@ public:
         double * jac1 = NULL, double * jac2 = NULL) const
     {
         assert(pVec.size() == qVec.size());
-        assert(res1 != NULL or res2 != NULL);
-        if (jac1 != NULL)
-        {
-            assert(res1 != NULL);
-        }
-        if (jac2 != NULL)
-        {
-            assert(res2 != NULL);
-        }
-        for (int i = 0; i < pVec.size(); i++)
-        {
-            computeRegular(pVec[i], qVec[i],
-                    res1 != NULL ? res1 + i : NULL,
-                    res2 != NULL ? res2 + i : NULL,
-                    jac1 != NULL ? jac1 + 6 * i : NULL,
-                    jac2 != NULL ? jac2 + 6 * i : NULL);
-        }
+        ArrayX3d pArr, qArr;
+        ICamera::toArray(pVec, pArr);
+        ICamera::toArray(qVec, qArr);
+        computeRegular(pArr, qArr, res1, res2, jac1, jac2);
     }
     
 private:
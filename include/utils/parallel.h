@@ -0,0 +1,190 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Minimal data-parallel loop on top of std::thread
+The range [begin, end) is cut into contiguous blocks of at least minBlock
+iterations, the blocks are distributed between the hardware threads.
+body(blockBegin, blockEnd) must not write to the data of other blocks.
+A loop nested in a block gets a share of the threads of the outer loop,
+so that the total number of threads stays about the hardware concurrency.
+*/
+
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include "std.h"
+
+// the number of threads available to the loops of the calling thread, 0 means all of them
+inline int & threadBudget()
+{
+    static thread_local int budget = 0;
+    return budget;
+}
+
+inline int numThreads()
+{
+    if (threadBudget() > 0) return threadBudget();
+    const int n = std::thread::hardware_concurrency();
+    return max(n, 1);
+}
+
+// the number of blocks parallelFor cuts a range of the given length into
+inline int parallelBlockNumber(const int length, const int minBlock)
+{
+    if (length <= 0) return 0;
+    return min(numThreads(), max(length / max(minBlock, 1), 1));
+}
+
+/*
+The same as parallelFor, body(blockIdx, blockBegin, blockEnd) also gets the index
+of its block, in [0, parallelBlockNumber(end - begin, minBlock)),
+to write into per-block buffers allocated in advance
+*/
+template<typename Body>
+void parallelForBlocks(const int begin, const int end, const int minBlock, const Body & body)
+{
+    const int length = end - begin;
+    const int numBlocks = parallelBlockNumber(length, minBlock);
+    if (numBlocks == 0) return;
+    if (numBlocks == 1)
+    {
+        body(0, begin, end);
+        return;
+    }
+
+    // the calling thread processes the last block
+    const int innerBudget = max(numThreads() / numBlocks, 1);
+    vector<std::thread> threadVec;
+    threadVec.reserve(numBlocks - 1);
+    for (int i = 0; i < numBlocks - 1; i++)
+    {
+        const int blockBegin = begin + (length * i) / numBlocks;
+        const int blockEnd = begin + (length * (i + 1)) / numBlocks;
+        threadVec.emplace_back([&body, i, blockBegin, blockEnd, innerBudget]()
+        {
+            threadBudget() = innerBudget;
+            body(i, blockBegin, blockEnd);
+        });
+    }
+    const int outerBudget = threadBudget();
+    threadBudget() = innerBudget;
+    body(numBlocks - 1, begin + (length * (numBlocks - 1)) / numBlocks, end);
+    threadBudget() = outerBudget;
+    for (auto & th : threadVec) th.join();
+}
+
+template<typename Body>
+void parallelFor(const int begin, const int end, const int minBlock, const Body & body)
+{
+    parallelForBlocks(begin, end, minBlock,
+            [&body](const int, const int blockBegin, const int blockEnd) { body(blockBegin, blockEnd); });
+}
+
+/*
+Fixed set of threads for the loops which are run many times,
+the threads are started once instead of at every loop.
+Every worker gets an equal share of the threads for its nested loops.
+*/
+class WorkerPool
+{
+public:
+    // numWorkers <= 1 means that the loops are run by the calling thread
+    explicit WorkerPool(const int numWorkers) :
+            _body(NULL),
+            _nextTask(0),
+            _numTasks(0),
+            _pendingTasks(0),
+            _stop(false)
+    {
+        if (numWorkers <= 1) return;
+        const int innerBudget = max(numThreads() / numWorkers, 1);
+        _threadVec.reserve(numWorkers);
+        for (int i = 0; i < numWorkers; i++)
+        {
+            _threadVec.emplace_back([this, innerBudget]()
+            {
+                threadBudget() = innerBudget;
+                work();
+            });
+        }
+    }
+    
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _startCondition.notify_all();
+        for (auto & th : _threadVec) th.join();
+    }
+    
+    // owns the threads
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool & operator = (const WorkerPool &) = delete;
+    
+    // runs body(i) for every i in [0, n) and returns when all of them are done;
+    // must not be called from the body
+    void run(const int n, const std::function<void(int)> & body)
+    {
+        if (_threadVec.empty())
+        {
+            for (int i = 0; i < n; i++) body(i);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _body = &body;
+        _nextTask = 0;
+        _numTasks = n;
+        _pendingTasks = n;
+        _startCondition.notify_all();
+        _doneCondition.wait(lock, [this]() { return _pendingTasks == 0; });
+        _body = NULL;
+        _numTasks = 0;
+    }
+    
+private:
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true)
+        {
+            _startCondition.wait(lock, [this]() { return _stop or _nextTask < _numTasks; });
+            if (_stop) return;
+            const int taskIdx = _nextTask++;
+            lock.unlock();
+            (*_body)(taskIdx);
+            lock.lock();
+            if (--_pendingTasks == 0) _doneCondition.notify_all();
+        }
+    }
+    
+    vector<std::thread> _threadVec;
+    std::mutex _mutex;
+    std::condition_variable _startCondition;
+    std::condition_variable _doneCondition;
+    const std::function<void(int)> * _body;
+    int _nextTask;
+    int _numTasks;
+    int _pendingTasks;
+    bool _stop;
+};
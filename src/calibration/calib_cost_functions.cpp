@@ -29,18 +29,19 @@ bool GenericProjectionJac::Evaluate(double const * const * params,
         double * residual, double ** jacobian) const
 {
     //compute the transformation chain
-    Transformation<double> xiAcc;
+    //the rotation matrices are composed, without the conversions to angle-axis
+    Pose<double> xiAcc;
     for (int paramIdx = 1; paramIdx <= _transformStatusVec.size(); paramIdx++)
     {
         auto const status = _transformStatusVec[paramIdx - 1];
         if (status == TRANSFORM_DIRECT)
         {
-            Transformation<double> xi(params[paramIdx]);
+            Pose<double> xi(Transformation<double>(params[paramIdx]));
             xiAcc = xiAcc.compose(xi);
         }
         else if (status == TRANSFORM_INVERSE)
         {
-            Transformation<double> xi(params[paramIdx]);
+            Pose<double> xi(Transformation<double>(params[paramIdx]));
             xiAcc = xiAcc.composeInverse(xi);
         }
     }
@@ -73,13 +74,13 @@ bool GenericProjectionJac::Evaluate(double const * const * params,
     if (jacobian != NULL)
     {
         //compute the transformation chain
-        Transformation<double> xiAcc;
+        Pose<double> xiAcc;
 //        for (int paramIdx = 0; paramIdx < _transformStatusVec.size(); paramIdx++) //FIXME
         for (int paramIdx = 1; paramIdx <= _transformStatusVec.size(); paramIdx++)
         {
             auto const status = _transformStatusVec[paramIdx - 1];
             Transformation<double> xi23(params[paramIdx]);
-            Transformation<double> xi13;
+            Pose<double> xi13;
             if (status == TRANSFORM_DIRECT)
             {
                 xiAcc = xiAcc.compose(xi23);
@@ -113,11 +113,8 @@ Matrixd<6, 3> OdometryCost::calc_acc(const vector<Transf> & tf0_n_vec, const vec
         }
         Matrix3<double> rot_0_j_mat = tf0_j.rotMat();             // Rotation Matrix 0Ri-1
 
-        Transformation <double> tf0_i = tf0_n_vec[i];                             // 0Ti
-        Transformation <double> tfi_0 = tf0_i.inverse();                         // iT0
-        Transformation <double> tfi_n = tfi_0.compose(tf0_n);                   // iTn
-
-        Vector3<double> trans_i_n = tfi_n.trans();
+        Pose <double> pose0_i(tf0_n_vec[i]);                                    // 0Ti
+        Vector3<double> trans_i_n = pose0_i.inverseTransform(tf0_n.trans());     // translation of iTn
 
 
         Matrix3d Jacobian;
@@ -29,11 +29,20 @@ Cost functions for localization based on photometric data and mutual information
 
 #include "geometry/geometry.h"
 #include "projection/generic_camera.h"
+#include "projection/camera_models.h"
 #include "projection/jacobian.h"
 #include "reconstruction/triangulator.h"
+#include "utils/parallel.h"
 
 bool MutualInformation::Evaluate(double const * parameters,
         double * cost, double * gradient) const
+{
+    return evaluate(*_camera, parameters, cost, gradient);
+}
+
+template<typename Camera>
+bool MutualInformation::evaluate(const Camera & camera, double const * parameters,
+        double * cost, double * gradient) const
 {
     const int POINT_NUMBER = _dataPack.cloud.size();
     for (int i = 0; i < 6; i++)
@@ -43,48 +52,69 @@ bool MutualInformation::Evaluate(double const * parameters,
     Transf xiBase(parameters);
     Transf xiCam = xiBase.compose(_xiBaseCam);
     
-    // point cloud in frame 2
-    vector<Vector3d> transformedPoints;
+    // point cloud in frame 2, read by the parallel blocks
+    Vector3dVec & transformedPoints = _transformedPoints;
     xiCam.inverseTransform(_dataPack.cloud, transformedPoints);
     // init the image interpolation
     ceres::BiCubicInterpolator<Grid2D<float>> imageInterpolator(_imageGrid);
     
     bool computeGrad = (gradient != NULL);
     
-    vector<double> valVec2(POINT_NUMBER, 0);
-    vector<Covector2d> gradVec;
-    if (computeGrad)
+    const int HIST_SIZE = _numBins * _numBins;
+    const int numBlocks = parallelBlockNumber(POINT_NUMBER, MIN_BLOCK_SIZE);
+    _valVec2.resize(POINT_NUMBER);
+    // dfdX = grad(img) * dp/dX, the projection Jacobian comes with the projection
+    if (computeGrad) _dfdXVec.resize(POINT_NUMBER);
+    _partialHistVec.assign(numBlocks * HIST_SIZE, 0.);
+    parallelForBlocks(0, POINT_NUMBER, MIN_BLOCK_SIZE,
+            [&](const int blockIdx, const int begin, const int end)
     {
-        gradVec.resize(POINT_NUMBER, Covector2d(0, 0));
-    }
-    *cost = 0;
-    for (int i = 0; i < POINT_NUMBER; i++)
-    {
-        Vector2d pt;
-        auto & X = transformedPoints[i];
-        if (_camera->projectPoint(transformedPoints[i], pt)) 
+        double * hist = _partialHistVec.data() + blockIdx * HIST_SIZE;
+        for (int i = begin; i < end; i++)
         {
+            Vector2d pt;
+            double & f = _valVec2[i];
+            f = 0;
             if (computeGrad)
             {
-                double & f = valVec2[i];
-                Covector2d & grad = gradVec[i];
-                // image interpolation and gradient
-                imageInterpolator.Evaluate(pt[1] * _invScale, pt[0] * _invScale,
-                        &f, &grad[1], &grad[0]);
-                grad *= _invScale;  // normalize according to the scale
+                Matrix23drm projJac;
+                _dfdXVec[i] = Covector3d(0, 0, 0);
+                if (camera.projectWithJacobian(transformedPoints[i], pt,
+                        projJac.data(), projJac.data() + 3))
+                {
+                    Covector2d grad;
+                    // image interpolation and gradient
+                    imageInterpolator.Evaluate(pt[1] * _invScale, pt[0] * _invScale,
+                            &f, &grad[1], &grad[0]);
+                    grad *= _invScale;  // normalize according to the scale
+                    _dfdXVec[i] = grad * projJac;
+                }
             }
-            else 
+            else if (camera.projectPoint(transformedPoints[i], pt)) 
             {
-                double & f = valVec2[i];
                 imageInterpolator.Evaluate(pt[1] * _invScale, pt[0] * _invScale, &f);
             }
-            
+            int idx21, idx22;
+            double share2;
+            computeShares(f, idx21, idx22, share2);
+            addToHist2d(_refIdx1Vec[i], _refIdx2Vec[i], _refShareVec[i], idx21, idx22, share2, hist);
         }
-        
+    });
+    
+    // reduce the partial histograms
+    _hist12.assign(HIST_SIZE, 0.);
+    for (int blockIdx = 0; blockIdx < numBlocks; blockIdx++)
+    {
+        const double * hist = _partialHistVec.data() + blockIdx * HIST_SIZE;
+        for (int k = 0; k < HIST_SIZE; k++) _hist12[k] += hist[k];
+    }
+    _hist2.assign(_numBins, 0.);
+    for (int idx2 = 0; idx2 < _numBins; idx2++)
+    {
+        _hist2[idx2] = accumulate(_hist12.begin() + idx2 * _numBins,
+                _hist12.begin() + (idx2 + 1) * _numBins, 0.);
     }
-    vector<double> hist12 = computeHist2d(_dataPack.valVec, valVec2);
-    vector<double> hist2 = reduceHist(hist12);
-    vector<double> logVec12(_numBins * _numBins, 0);
+    _logVec12.assign(HIST_SIZE, 0.);
     
     // compute the cost
     *cost = 0;
@@ -92,11 +122,11 @@ bool MutualInformation::Evaluate(double const * parameters,
     {
         for (int idx1 = 0; idx1 < _numBins; idx1++)
         {
-            const double & p12 = hist12[idx2 * _numBins + idx1];
-            const double log12 = log(p12 / (hist2[idx2] * _hist1[idx1]));
+            const double & p12 = _hist12[idx2 * _numBins + idx1];
             if (p12 > 0)
             {
-                logVec12[idx2 * _numBins + idx1] = log12;
+                const double log12 = log(p12 / (_hist2[idx2] * _hist1[idx1]));
+                _logVec12[idx2 * _numBins + idx1] = log12;
                 *cost -= p12*log12;
             }
         }
@@ -104,44 +134,64 @@ bool MutualInformation::Evaluate(double const * parameters,
     // compute the gradient
     if (computeGrad)
     {
-        Map<Covector6d> dMIdxi(gradient);
-        dMIdxi << 0, 0, 0, 0, 0, 0;
         // L_uTheta
-        CameraJacobian jacobianCalculator(_camera, xiBase, _xiBaseCam);
-        for (int i = 0; i < POINT_NUMBER; i++)
+        const CameraModelJacobian<Camera> jacobianCalculator(&camera, xiBase, _xiBaseCam);
+        _partialGradVec.assign(numBlocks * 6, 0.);
+        parallelForBlocks(0, POINT_NUMBER, MIN_BLOCK_SIZE,
+                [&](const int blockIdx, const int begin, const int end)
         {
-            Covector6d dfdxi;
-            jacobianCalculator.dfdxi(transformedPoints[i], gradVec[i], dfdxi.data());
-            
-            // dP/df and dMI/dP
-            int idx11, idx12;
-            int idx21, idx22;
-            double dPdf, share1;
-            computeShareDerivative(valVec2[i], idx21, idx22, dPdf);
-            computeShares(_dataPack.valVec[i], idx11, idx12, share1);
-            double dMIdP = 0;
-           
-            if (idx22 != -1)
+            Map<Covector6d> dMIdxi(_partialGradVec.data() + blockIdx * 6);
+            for (int i = begin; i < end; i++)
             {
-                if (idx12 != -1)
-                {
-                    dMIdP = logVec12[idx21 * _numBins + idx11] * share1
-                        + logVec12[idx21 * _numBins + idx12] * (1 - share1)
-                        - logVec12[idx22 * _numBins + idx11] * share1
-                        - logVec12[idx22 * _numBins + idx12] * (1 - share1);
-                }
-                else
+                Covector6d dfdxi;
+                jacobianCalculator.dfdxi(transformedPoints[i], _dfdXVec[i], dfdxi.data());
+                
+                // dP/df and dMI/dP
+                const int & idx11 = _refIdx1Vec[i];
+                const int & idx12 = _refIdx2Vec[i];
+                const double & share1 = _refShareVec[i];
+                int idx21, idx22;
+                double dPdf;
+                computeShareDerivative(_valVec2[i], idx21, idx22, dPdf);
+                double dMIdP = 0;
+               
+                if (idx22 != -1)
                 {
-                    dMIdP = logVec12[idx21 * _numBins + idx11]
-                        - logVec12[idx22 * _numBins + idx11];
+                    if (idx12 != -1)
+                    {
+                        dMIdP = _logVec12[idx21 * _numBins + idx11] * share1
+                            + _logVec12[idx21 * _numBins + idx12] * (1 - share1)
+                            - _logVec12[idx22 * _numBins + idx11] * share1
+                            - _logVec12[idx22 * _numBins + idx12] * (1 - share1);
+                    }
+                    else
+                    {
+                        dMIdP = _logVec12[idx21 * _numBins + idx11]
+                            - _logVec12[idx22 * _numBins + idx11];
+                    }
                 }
+                double dMIdf = dMIdP * _increment * dPdf;
+                dMIdxi -= dMIdf * dfdxi;
             }
-            double dMIdf = dMIdP * _increment * dPdf;
-            dMIdxi -= dMIdf * dfdxi;
+        });
+        Map<Covector6d> dMIdxi(gradient);
+        dMIdxi << 0, 0, 0, 0, 0, 0;
+        for (int blockIdx = 0; blockIdx < numBlocks; blockIdx++)
+        {
+            dMIdxi += Map<const Covector6d>(_partialGradVec.data() + blockIdx * 6);
         }
     }
     return true;
 }
+
+MutualInformation * makeMutualInformation(const ICamera * camera, const PhotometricPack & dataPack,
+        const Transf xiBaseCam, const Mat32f & img2, double scale, int numBins, double valMax)
+{
+    MutualInformation * costFunction = newCameraModel<MutualInformation, ModelMutualInformation>(
+            CameraModels(), camera, dataPack, xiBaseCam, img2, scale, numBins, valMax);
+    if (costFunction != NULL) return costFunction;
+    return new MutualInformation(camera, dataPack, xiBaseCam, img2, scale, numBins, valMax);
+}
     
 void MutualInformation::computeShareDerivative(double val, int & idx1, int & idx2, double & der) const
 {
@@ -250,31 +300,49 @@ vector<double> MutualInformation::computeHist2d(const vector<double> & valVec1,
         double share1, share2;
         computeShares(valVec1[i], idx11, idx12, share1);
         computeShares(valVec2[i], idx21, idx22, share2);
-        if (idx12 != -1 and idx22 != -1) 
-        {
-            hist[idx21 * _numBins + idx11] += _increment * share1*share2;
-            hist[idx21 * _numBins + idx12] += _increment *(1 - share1)*share2;
-            hist[idx22 * _numBins + idx11] += _increment *(1 - share2)*share1;
-            hist[idx22 * _numBins + idx12] += _increment *(1 - share1)*(1 - share2);
-        }
-        else if (idx12 != -1) 
-        {
-            hist[idx21 * _numBins + idx11] += share1*_increment;
-            hist[idx21 * _numBins + idx12] += (1 - share1)*_increment;
-        }
-        else if (idx22 != -1) 
-        {
-            hist[idx21 * _numBins + idx11] += _increment*share2;
-            hist[idx22 * _numBins + idx11] += (1 - share2)*_increment;
-        }
-        else
-        {
-            hist[idx21 * _numBins + idx11] += _increment;
-        }
+        addToHist2d(idx11, idx12, share1, idx21, idx22, share2, hist.data());
     }
     return hist;
 }
 
+void MutualInformation::addToHist2d(int idx11, int idx12, double share1,
+        int idx21, int idx22, double share2, double * hist) const
+{
+    if (idx12 != -1 and idx22 != -1) 
+    {
+        hist[idx21 * _numBins + idx11] += _increment * share1*share2;
+        hist[idx21 * _numBins + idx12] += _increment *(1 - share1)*share2;
+        hist[idx22 * _numBins + idx11] += _increment *(1 - share2)*share1;
+        hist[idx22 * _numBins + idx12] += _increment *(1 - share1)*(1 - share2);
+    }
+    else if (idx12 != -1) 
+    {
+        hist[idx21 * _numBins + idx11] += share1*_increment;
+        hist[idx21 * _numBins + idx12] += (1 - share1)*_increment;
+    }
+    else if (idx22 != -1) 
+    {
+        hist[idx21 * _numBins + idx11] += _increment*share2;
+        hist[idx22 * _numBins + idx11] += (1 - share2)*_increment;
+    }
+    else
+    {
+        hist[idx21 * _numBins + idx11] += _increment;
+    }
+}
+
+void MutualInformation::initReference()
+{
+    const int POINT_NUMBER = _dataPack.valVec.size();
+    _refIdx1Vec.resize(POINT_NUMBER);
+    _refIdx2Vec.resize(POINT_NUMBER);
+    _refShareVec.resize(POINT_NUMBER);
+    for (int i = 0; i < POINT_NUMBER; i++)
+    {
+        computeShares(_dataPack.valVec[i], _refIdx1Vec[i], _refIdx2Vec[i], _refShareVec[i]);
+    }
+}
+
 vector<double> MutualInformation::reduceHist(const vector<double> & hist2d) const
 {
     assert(hist2d.size() % _numBins == 0);
@@ -352,19 +420,23 @@ MutualInformationOdom::MutualInformationOdom(  const ICamera * camera,
 
 bool MutualInformationOdom::Evaluate(double const * parameters, double * cost, double * gradient) const
 {
-    MutualInformation::Evaluate(parameters, cost, gradient);
+    if (not MutualInformation::Evaluate(parameters, cost, gradient)) return false;
     Transf xi(parameters);
     Covector6d err;
     _xiPrior.inverseCompose(xi).toArray(err.data());
     
     const double DAMPING = 0.0002;
     
-    Vector6d priorGrad = err * _J;
-    for (int i = 0; i < 6; i++)
+    if (gradient != NULL)
     {
-        gradient[i] += priorGrad[i] * DAMPING;
+        Vector6d priorGrad = err * _J;
+        for (int i = 0; i < 6; i++)
+        {
+            gradient[i] += priorGrad[i] * DAMPING;
+        }
     }
     *cost += DAMPING * double(err * _C * err.transpose());
+    return true;
 }
 
 
@@ -0,0 +1,176 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Inverse compositional photometric alignment
+*/
+
+#include "localization/inverse_compositional.h"
+
+#include <mutex>
+
+#include "std.h"
+#include "eigen.h"
+#include "ocv.h"
+#include "ceres.h"
+#include "io.h"
+#include "timer.h"
+
+#include "geometry/geometry.h"
+#include "projection/generic_camera.h"
+#include "utils/parallel.h"
+
+InverseCompositionalAlignment::InverseCompositionalAlignment(const ICamera * camera,
+        const Transf & xiBaseCam, const PhotometricPack & dataPack,
+        const Mat32f & gradU1, const Mat32f & gradV1, double scale) :
+        _camera(camera->clone()),
+        _xiBaseCam(xiBaseCam),
+        _dataPack(dataPack),
+        _invScale(1. / scale),
+        _maxIterations(50),
+        MARGIN_SIZE(50. / scale)
+{
+    const int POINT_NUMBER = _dataPack.cloud.size();
+    _xiBaseCam.inverseTransform(_dataPack.cloud, _xVec);
+    _jacobian.resize(POINT_NUMBER, 6);
+    _hessian.setZero();
+    for (int i = 0; i < POINT_NUMBER; i++)
+    {
+        const Vector3d & X = _xVec[i];
+        Matrix23drm projJac;
+        Map<Covector6d> J(_jacobian.data() + i*6);
+        if (not _camera->projectionJacobian(X, projJac.data(), projJac.data() + 3))
+        {
+            J.setZero();
+            continue;
+        }
+        // the gradient is taken at the pixel the point was reconstructed from
+        const int & idx = _dataPack.idxVec[i];
+        Covector2d grad(gradU1(idx / gradU1.cols, idx % gradU1.cols),
+                gradV1(idx / gradU1.cols, idx % gradU1.cols));
+        grad *= _invScale;  // normalize according to the scale
+        const Covector3d dfdX = grad * projJac;
+
+        // d(dxi X) / d(dxi) = [ I  -hat(X) ] at dxi = 0
+        J.head<3>() = dfdX;
+        J.tail<3>() = -dfdX * hat(X);
+        _hessian += J.transpose() * J;
+    }
+}
+
+bool InverseCompositionalAlignment::inMargin(const Vector2d & pt, const Grid2D<float> & imageGrid) const
+{
+    const double uScale = pt[0] * _invScale;
+    const double vScale = pt[1] * _invScale;
+    return uScale < MARGIN_SIZE or uScale > imageGrid.uMax - MARGIN_SIZE - 1
+            or vScale < MARGIN_SIZE or vScale > imageGrid.vMax - MARGIN_SIZE - 1;
+}
+
+double InverseCompositionalAlignment::accumulate(const Transf & xi21, const Grid2D<float> & imageGrid,
+        Vector6d & Jtr, Matrix6d & excludedHessian) const
+{
+    // reference points in the camera frame 2, read by the parallel blocks
+    Vector3dVec & transformedPoints = _transformedPoints;
+    xi21.transform(_xVec, transformedPoints);
+
+    ceres::BiCubicInterpolator<Grid2D<float>> imageInterpolator(imageGrid);
+
+    Jtr.setZero();
+    excludedHessian.setZero();
+    std::mutex sumMutex;
+    double cost = 0;
+    parallelFor(0, transformedPoints.size(), 1024, [&](const int begin, const int end)
+    {
+        Vector6d blockJtr = Vector6d::Zero();
+        Matrix6d blockExcluded = Matrix6d::Zero();
+        double blockCost = 0;
+        for (int i = begin; i < end; i++)
+        {
+            Map<const Covector6d> J(_jacobian.data() + i*6);
+            Vector2d pt;
+            if (not _camera->projectPoint(transformedPoints[i], pt) or inMargin(pt, imageGrid))
+            {
+                blockExcluded.noalias() += J.transpose() * J;
+                continue;
+            }
+            double f;
+            imageInterpolator.Evaluate(pt[1] * _invScale, pt[0] * _invScale, &f);
+            const double res = saturate(f - _dataPack.valVec[i]);
+            blockCost += res * res;
+            blockJtr.noalias() += J.transpose() * res;
+        }
+        std::lock_guard<std::mutex> lock(sumMutex);
+        cost += blockCost;
+        Jtr += blockJtr;
+        excludedHessian += blockExcluded;
+    });
+    return 0.5 * cost;
+}
+
+PoseSolverSummary InverseCompositionalAlignment::align(Transf & T12, const Mat32f & img2,
+        double maxTime) const
+{
+    Timer timer;
+    const Grid2D<float> imageGrid(img2.cols, img2.rows, (float*)(img2.data));
+
+    // the motion of the camera, expressed in the camera frame 1
+    Transf xi12 = _xiBaseCam.inverseCompose(T12.compose(_xiBaseCam));
+    Transf xi21 = xi12.inverse();
+    Transf xi21Prev = xi21;
+    double costPrev = DOUBLE_INF;
+    PoseSolverSummary summary;
+    for (; summary.iterations < _maxIterations; summary.iterations++)
+    {
+        if (maxTime > 0 and timer.elapsed() > maxTime)
+        {
+            summary.timeLimitReached = true;
+            break;
+        }
+        
+        Vector6d Jtr;
+        Matrix6d excludedHessian;
+        const double cost = accumulate(xi21, imageGrid, Jtr, excludedHessian);
+        if (summary.iterations == 0) summary.initialCost = cost;
+        if (cost >= costPrev)
+        {
+            xi21 = xi21Prev;
+            summary.converged = true;
+            break;
+        }
+
+        xi21Prev = xi21;
+        costPrev = cost;
+
+        auto solver = Matrix6d(_hessian - excludedHessian).ldlt();
+        if (solver.info() != Eigen::Success or not solver.isPositive()) break;
+        const Vector6d dxi = solver.solve(Jtr);
+
+        // the increment is applied to the reference points: T21 <- T21 dxi^-1
+        xi21 = xi21.composeInverse(Transf(dxi.data()));
+        if (dxi.norm() < STEP_TOLERANCE)
+        {
+            summary.converged = true;
+            break;
+        }
+    }
+    // the last step has not been checked if the iterations were cut
+    if (not summary.converged) xi21 = xi21Prev;
+    if (summary.iterations > 0) summary.finalCost = costPrev;
+    T12 = _xiBaseCam.compose(xi21.inverse()).composeInverse(_xiBaseCam);
+    return summary;
+}
+
@@ -0,0 +1,275 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Disk-backed keyframe storage
+*/
+
+#include "localization/keyframe_database.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "std.h"
+#include "eigen.h"
+#include "ocv.h"
+#include "io.h"
+#include "except.h"
+
+#include "geometry/geometry.h"
+
+namespace
+{
+
+const char FILE_MAGIC[8] = {'V', 'G', 'K', 'F', 'D', 'B', '0', '2'};
+const uint32_t RECORD_MAGIC = 0x4B465243;
+
+struct RecordHeader
+{
+    uint32_t magic;
+    int32_t rows, cols;
+    double pose[6];
+    uint64_t dataSize;  // the image
+};
+
+// the header of an incomplete or corrupted record does not describe its data
+bool isConsistent(const RecordHeader & header)
+{
+    if (header.magic != RECORD_MAGIC) return false;
+    if (header.rows < 0 or header.cols < 0) return false;
+    return header.dataSize == uint64_t(header.rows) * uint64_t(header.cols);
+}
+
+bool writeAll(int fd, const void * data, size_t length, size_t offset)
+{
+    const uint8_t * ptr = static_cast<const uint8_t *>(data);
+    while (length > 0)
+    {
+        const ssize_t written = pwrite(fd, ptr, length, offset);
+        if (written <= 0) return false;
+        ptr += written;
+        offset += written;
+        length -= written;
+    }
+    return true;
+}
+
+} // namespace
+
+KeyframeDatabase::KeyframeDatabase(int maxResident) :
+        _maxResident(max(maxResident, 1)),
+        _fd(-1),
+        _mapPtr(NULL),
+        _mapSize(0),
+        _fileSize(0) {}
+
+bool KeyframeDatabase::open(const string & fileName)
+{
+    close();
+    _fd = ::open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd == -1) return false;
+    struct stat fileStat;
+    if (fstat(_fd, &fileStat) != 0)
+    {
+        close();
+        return false;
+    }
+    _fileSize = fileStat.st_size;
+    
+    if (_fileSize == 0)
+    {
+        if (not writeAll(_fd, FILE_MAGIC, sizeof(FILE_MAGIC), 0))
+        {
+            close();
+            return false;
+        }
+        _fileSize = sizeof(FILE_MAGIC);
+        return true;
+    }
+    
+    const uint8_t * magic = fileData(0, sizeof(FILE_MAGIC));
+    if (magic == NULL or memcmp(magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0)
+    {
+        cout << "ERROR : " << fileName << " is not a keyframe database" << endl;
+        close();
+        return false;
+    }
+    
+    // only the headers are read
+    size_t offset = sizeof(FILE_MAGIC);
+    while (offset + sizeof(RecordHeader) <= _fileSize)
+    {
+        const uint8_t * headerData = fileData(offset, sizeof(RecordHeader));
+        if (headerData == NULL)
+        {
+            cout << "ERROR : cannot map " << fileName << endl;
+            close();
+            return false;
+        }
+        RecordHeader header;
+        memcpy(&header, headerData, sizeof(RecordHeader));
+        const size_t dataOffset = offset + sizeof(RecordHeader);
+        // the record is dropped like a truncated one
+        if (not isConsistent(header) or header.dataSize > _fileSize - dataOffset) break;
+        
+        Entry entry;
+        entry.xi = Transf(header.pose);
+        entry.offset = dataOffset;
+        entry.rows = header.rows;
+        entry.cols = header.cols;
+        _entryVec.push_back(entry);
+        offset = dataOffset + header.dataSize;
+    }
+    
+    // the new records overwrite an incomplete one
+    if (offset != _fileSize)
+    {
+        cout << "WARNING : the keyframe database is truncated after "
+                << _entryVec.size() << " keyframes" << endl;
+        if (ftruncate(_fd, offset) != 0)
+        {
+            close();
+            return false;
+        }
+        _fileSize = offset;
+    }
+    return true;
+}
+
+void KeyframeDatabase::close()
+{
+    if (_mapPtr != NULL) munmap(_mapPtr, _mapSize);
+    if (_fd != -1) ::close(_fd);
+    _mapPtr = NULL;
+    _mapSize = 0;
+    _fileSize = 0;
+    _fd = -1;
+    _entryVec.clear();
+    _residentList.clear();
+    _residentMap.clear();
+}
+
+const uint8_t * KeyframeDatabase::fileData(size_t offset, size_t length)
+{
+    if (offset + length > _fileSize) return NULL;
+    if (offset + length > _mapSize)
+    {
+        // the whole file is mapped again, it is rare as the records are read after being written
+        if (_mapPtr != NULL) munmap(_mapPtr, _mapSize);
+        void * ptr = mmap(NULL, _fileSize, PROT_READ, MAP_SHARED, _fd, 0);
+        if (ptr == MAP_FAILED)
+        {
+            _mapPtr = NULL;
+            _mapSize = 0;
+            return NULL;
+        }
+        _mapPtr = static_cast<uint8_t *>(ptr);
+        _mapSize = _fileSize;
+    }
+    return _mapPtr + offset;
+}
+
+int KeyframeDatabase::add(const Mat8u & img, const Transf & xi)
+{
+    assert(isOpen());
+    RecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = RECORD_MAGIC;
+    header.rows = img.rows;
+    header.cols = img.cols;
+    xi.toArray(header.pose);
+    const uint64_t imageSize = uint64_t(img.rows) * img.cols;
+    header.dataSize = imageSize;
+    
+    const size_t offset = _fileSize;
+    bool ok = writeAll(_fd, &header, sizeof(header), offset);
+    if (img.isContinuous())
+    {
+        ok = ok and writeAll(_fd, img.data, imageSize, offset + sizeof(header));
+    }
+    else
+    {
+        for (int v = 0; v < img.rows and ok; v++)
+        {
+            ok = writeAll(_fd, img.ptr(v), img.cols, offset + sizeof(header) + v * img.cols);
+        }
+    }
+    // the record is ignored at the next opening if it is incomplete
+    if (not ok) throw runtime_error("KeyframeDatabase : cannot write the keyframe");
+    _fileSize = offset + sizeof(header) + header.dataSize;
+    
+    Entry entry;
+    entry.xi = xi;
+    entry.offset = offset + sizeof(header);
+    entry.rows = img.rows;
+    entry.cols = img.cols;
+    _entryVec.push_back(entry);
+    
+    // the image is likely to be used soon
+    touch(_entryVec.size() - 1, img);
+    return _entryVec.size() - 1;
+}
+
+void KeyframeDatabase::touch(int idx, const Mat8u & img)
+{
+    auto mapIter = _residentMap.find(idx);
+    if (mapIter != _residentMap.end())
+    {
+        _residentList.splice(_residentList.begin(), _residentList, mapIter->second);
+        return;
+    }
+    _residentList.emplace_front(idx, img);
+    _residentMap[idx] = _residentList.begin();
+    while (int(_residentList.size()) > _maxResident)
+    {
+        _residentMap.erase(_residentList.back().first);
+        _residentList.pop_back();
+    }
+}
+
+Mat8u KeyframeDatabase::image(int idx)
+{
+    auto mapIter = _residentMap.find(idx);
+    if (mapIter != _residentMap.end())
+    {
+        Mat8u img = mapIter->second->second;
+        touch(idx, img);
+        return img;
+    }
+    const Entry & entry = _entryVec[idx];
+    const uint8_t * data = fileData(entry.offset, size_t(entry.rows) * entry.cols);
+    if (data == NULL) throw runtime_error("KeyframeDatabase : cannot map the keyframe");
+    // a copy, the mapping may move when the file grows
+    Mat8u img(entry.rows, entry.cols);
+    memcpy(img.data, data, size_t(entry.rows) * entry.cols);
+    touch(idx, img);
+    return img;
+}
+
+void KeyframeDatabase::setMaxResident(int val)
+{
+    _maxResident = max(val, 1);
+    while (int(_residentList.size()) > _maxResident)
+    {
+        _residentMap.erase(_residentList.back().first);
+        _residentList.pop_back();
+    }
+}
+
@@ -0,0 +1,137 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Spatial index over the keyframe positions
+*/
+
+#include "localization/keyframe_index.h"
+
+#include "std.h"
+#include "eigen.h"
+
+KeyframeIndex::KeyframeIndex(double cellSize) :
+        _cellSize(cellSize),
+        _invCellSize(1. / cellSize)
+{
+    assert(cellSize > 0);
+}
+
+void KeyframeIndex::insert(int idx, const Vector3d & position)
+{
+    const int x = cellCoord(position[0]);
+    const int y = cellCoord(position[1]);
+    const int z = cellCoord(position[2]);
+    _cellMap[cellKey(x, y, z)].push_back(_positionVec.size());
+    _positionVec.push_back(position);
+    _indexVec.push_back(idx);
+}
+
+void KeyframeIndex::clear()
+{
+    _cellMap.clear();
+    _positionVec.clear();
+    _indexVec.clear();
+}
+
+void KeyframeIndex::visitCell(int x, int y, int z, const Vector3d & center,
+        vector<pair<double, int>> & distVec) const
+{
+    auto cellIter = _cellMap.find(cellKey(x, y, z));
+    if (cellIter == _cellMap.end()) return;
+    for (int i : cellIter->second)
+    {
+        distVec.emplace_back((_positionVec[i] - center).squaredNorm(), i);
+    }
+}
+
+vector<int> KeyframeIndex::radiusSearch(const Vector3d & center, double radius) const
+{
+    vector<pair<double, int>> distVec;
+    const int x0 = cellCoord(center[0] - radius), x1 = cellCoord(center[0] + radius);
+    const int y0 = cellCoord(center[1] - radius), y1 = cellCoord(center[1] + radius);
+    const int z0 = cellCoord(center[2] - radius), z1 = cellCoord(center[2] + radius);
+    for (int x = x0; x <= x1; x++)
+    {
+        for (int y = y0; y <= y1; y++)
+        {
+            for (int z = z0; z <= z1; z++)
+            {
+                visitCell(x, y, z, center, distVec);
+            }
+        }
+    }
+    vector<int> res;
+    const double radiusSq = radius * radius;
+    for (auto & item : distVec)
+    {
+        if (item.first <= radiusSq) res.push_back(_indexVec[item.second]);
+    }
+    return res;
+}
+
+vector<int> KeyframeIndex::nearest(const Vector3d & center, int k) const
+{
+    k = min(k, size());
+    vector<pair<double, int>> distVec;
+    if (k <= 0) return vector<int>();
+    
+    // the cells are visited by shells of growing Chebyshev radius r,
+    // the points beyond the shell r are farther than r * _cellSize
+    const int cx = cellCoord(center[0]);
+    const int cy = cellCoord(center[1]);
+    const int cz = cellCoord(center[2]);
+    for (int r = 0; ; r++)
+    {
+        // for sparse far data scanning all the points is cheaper than growing the shells
+        if (pow(2 * r + 1, 3) > 8 * _cellMap.size())
+        {
+            distVec.clear();
+            for (int i = 0; i < size(); i++)
+            {
+                distVec.emplace_back((_positionVec[i] - center).squaredNorm(), i);
+            }
+            break;
+        }
+        for (int x = cx - r; x <= cx + r; x++)
+        {
+            for (int y = cy - r; y <= cy + r; y++)
+            {
+                const bool onFace = (abs(x - cx) == r or abs(y - cy) == r);
+                // inside the shell only the two caps are visited
+                for (int z = cz - r; z <= cz + r; z += (onFace or r == 0 ? 1 : 2 * r))
+                {
+                    visitCell(x, y, z, center, distVec);
+                }
+            }
+        }
+        if (int(distVec.size()) >= k)
+        {
+            std::nth_element(distVec.begin(), distVec.begin() + k - 1, distVec.end());
+            const double bound = r * _cellSize;
+            if (distVec[k - 1].first <= bound * bound or int(distVec.size()) == size()) break;
+        }
+    }
+    std::partial_sort(distVec.begin(), distVec.begin() + k, distVec.end());
+    vector<int> res;
+    for (int i = 0; i < k; i++)
+    {
+        res.push_back(_indexVec[distVec[i].second]);
+    }
+    return res;
+}
+
@@ -21,6 +21,8 @@ Cost functions for localization based on photometric data and mutual information
 
 #include "localization/local_cost_functions.h"
 
+#include <mutex>
+
 #include "std.h"
 #include "eigen.h"
 #include "ocv.h" //TODO replace here Mat32f by a pointer
@@ -29,8 +31,10 @@ Cost functions for localization based on photometric data and mutual information
 
 #include "geometry/geometry.h"
 #include "projection/generic_camera.h"
+#include "projection/camera_models.h"
 #include "projection/jacobian.h"
 #include "reconstruction/triangulator.h"
+#include "utils/parallel.h"
 
 PhotometricCostFunction::PhotometricCostFunction(const ICamera * camera, const Transf & xiBaseCam,
             const PhotometricPack & dataPack,
@@ -94,31 +98,47 @@ double PhotometricCostFunction::getVMapgin(const double & v) const
 bool PhotometricCostFunction::Evaluate(double const * const * parameters,
         double * residual, double ** jacobian) const
 {
-    const int POINT_NUMBER = _dataPack.cloud.size();
-    
+    return evaluate(*_camera, parameters, residual, jacobian);
+}
+
+template<typename Camera>
+bool PhotometricCostFunction::evaluate(const Camera & camera, double const * const * parameters,
+        double * residual, double ** jacobian) const
+{
     Transf xiBase(parameters[0]);
     Transf xiCam = xiBase.compose(_xiBaseCam);
-    // point cloud in frame 2
-    vector<Vector3d> transformedPoints;
+    Vector3dVec & transformedPoints = _transformedPoints;
     xiCam.inverseTransform(_dataPack.cloud, transformedPoints);
     
+    bool computeJac = (jacobian != NULL and jacobian[0] != NULL);
+    // L_uTheta
+    const CameraModelJacobian<Camera> jacobianCalculator(&camera, xiBase, _xiBaseCam);
+    evaluateRange(camera, jacobianCalculator, transformedPoints, 0, transformedPoints.size(),
+            residual, computeJac ? jacobian[0] : NULL);
+    return true;
+}
+
+template<typename Camera>
+void PhotometricCostFunction::evaluateRange(const Camera & camera,
+        const CameraModelJacobian<Camera> & jacobianCalculator,
+        const Vector3dVec & transformedPoints, const int begin, const int end,
+        double * residual, double * jacobian) const
+{
     // init the image interpolation
     ceres::BiCubicInterpolator<Grid2D<float>> imageInterpolator(_imageGrid);
     
-    bool computeJac = (jacobian != NULL and jacobian[0] != NULL);
     const double FADE = 0.01 * MARGIN_SIZE * MARGIN_SIZE;
-    if (computeJac)
+    if (jacobian != NULL)
     {
-        // L_uTheta
-        CameraJacobian jacobianCalculator(_camera, xiBase, _xiBaseCam);
-        for (int i = 0; i < POINT_NUMBER; i++)
+        for (int i = begin, j = 0; i < end; i++, j++)
         {
             Vector2d pt;
-//            bool projRes = 
-            if (not _camera->projectPoint(transformedPoints[i], pt)) 
+            Matrix23drm projJac;
+            if (not camera.projectWithJacobian(transformedPoints[i], pt,
+                    projJac.data(), projJac.data() + 3)) 
             {
-                residual[i] = 0;
-                fill(jacobian[0] + i*6, jacobian[0] + i*6 + 6, 0.);
+                residual[j] = 0;
+                fill(jacobian + j*6, jacobian + j*6 + 6, 0.);
                 continue;
             }
             
@@ -137,35 +157,23 @@ bool PhotometricCostFunction::Evaluate(double const * const * parameters,
             
             grad *= _invScale;  // normalize according to the scale
             
-            residual[i] = (f - _dataPack.valVec[i]);
+            residual[j] = (f - _dataPack.valVec[i]);
             double drhoderr;
-            lossFunction(residual[i], residual[i], drhoderr);
+            lossFunction(residual[j], residual[j], drhoderr);
             
             
             
             if (uMarg == 0 and vMarg == 0)
             {
                 Covector6d dfdxi;
-                jacobianCalculator.dfdxi(transformedPoints[i], grad, dfdxi.data());
+                jacobianCalculator.dfdxi(transformedPoints[i], Covector3d(grad * projJac), dfdxi.data());
                 dfdxi *= drhoderr;
-                copy(dfdxi.data(), dfdxi.data() + 6, jacobian[0] + i*6);
-//                for (int k = 0; k < 6; k++)
-//                {
-//                    if (abs(jacobian[0][i*6  + k]) > 1e5)
-//                    {
-//                        cout << "Jac is BIG : " << jacobian[0][i*6  + k] << endl;
-//                        cout << "Transformed point " << transformedPoints[i].transpose() << endl;
-//                        cout << "projection " << pt.transpose() << " //// " 
-//                                << _imageGrid.uMax << " " << _imageGrid.vMax << endl;
-//                        cout << "gradient " << grad << endl;
-//                        break;
-//                    }
-//                }
+                copy(dfdxi.data(), dfdxi.data() + 6, jacobian + j*6);
             }
             else
             {
                 Covector6d dudxi, dvdxi;
-                jacobianCalculator.dpdxi(transformedPoints[i], dudxi.data(), dvdxi.data());
+                jacobianCalculator.dpdxi(transformedPoints[i], projJac, dudxi.data(), dvdxi.data());
                 Covector6d drhodxi = (drhoderr * grad[0]) * dudxi + (drhoderr * grad[1]) * dvdxi; 
             
                 //fade-away margins
@@ -174,44 +182,110 @@ bool PhotometricCostFunction::Evaluate(double const * const * parameters,
                 const double dphidu = K * uMarg;
                 const double dphidv = K * vMarg;
                 
-                Map<Covector6d>(jacobian[0] + i*6) = (drhodxi * phi + 
-                                                    residual[i] * (dphidu * dudxi + dphidv * dvdxi))*0;
-                residual[i] *= phi * 0;
+                Map<Covector6d>(jacobian + j*6) = (drhodxi * phi + 
+                                                    residual[j] * (dphidu * dudxi + dphidv * dvdxi))*0;
+                residual[j] *= phi * 0;
             }
         }
     }
     else
     {
-        for (int i = 0; i < POINT_NUMBER; i++)
+        for (int i = begin, j = 0; i < end; i++, j++)
         {
             Vector2d pt;
-            if (not _camera->projectPoint(transformedPoints[i], pt)) 
+            if (not camera.projectPoint(transformedPoints[i], pt)) 
             {
-                residual[i] = 0.;
+                residual[j] = 0.;
                 continue;
             }
             
             double f;
             imageInterpolator.Evaluate(pt[1] * _invScale, pt[0] * _invScale, &f);
-            residual[i] = (f - _dataPack.valVec[i]);
+            residual[j] = (f - _dataPack.valVec[i]);
             double k;
-            lossFunction(residual[i], residual[i], k);
+            lossFunction(residual[j], residual[j], k);
             const double uMarg = getUMapgin(pt[0]);
             const double vMarg = getVMapgin(pt[1]);
             if (uMarg != 0 or vMarg != 0)
             {
                 
                 const double phi = FADE / (FADE + uMarg * uMarg + vMarg * vMarg);
-                residual[i] *= phi * 0;
+                residual[j] *= phi * 0;
             }
             
         }
     }
-    return true;
 }
 
+double PhotometricCostFunction::accumulateNormalEquations(const double * pose,
+        Matrix6d & JtJ, Vector6d & Jtr) const
+{
+    return accumulate(*_camera, pose, &JtJ, &Jtr);
+}
+
+double PhotometricCostFunction::computeCost(const double * pose) const
+{
+    return accumulate(*_camera, pose, NULL, NULL);
+}
 
+template<typename Camera>
+double PhotometricCostFunction::accumulate(const Camera & camera, const double * pose,
+        Matrix6d * JtJ, Vector6d * Jtr) const
+{
+    Transf xiBase(pose);
+    Transf xiCam = xiBase.compose(_xiBaseCam);
+    // the blocks read the buffer of this object, it is captured by reference
+    Vector3dVec & transformedPoints = _transformedPoints;
+    xiCam.inverseTransform(_dataPack.cloud, transformedPoints);
+    
+    const CameraModelJacobian<Camera> jacobianCalculator(&camera, xiBase, _xiBaseCam);
+    const bool computeJac = (JtJ != NULL);
+    
+    // every thread sums its block, the jacobian rows live only in a small stack buffer
+    const int CHUNK_SIZE = 64;
+    const int MIN_BLOCK_SIZE = 1024;
+    std::mutex sumMutex;
+    double cost = 0;
+    parallelFor(0, transformedPoints.size(), MIN_BLOCK_SIZE, [&](const int begin, const int end)
+    {
+        double residual[CHUNK_SIZE];
+        Matrix<double, CHUNK_SIZE, 6, RowMajor> jac;
+        Matrix6d blockJtJ = Matrix6d::Zero();
+        Vector6d blockJtr = Vector6d::Zero();
+        double blockCost = 0;
+        for (int i = begin; i < end; i += CHUNK_SIZE)
+        {
+            const int n = min(CHUNK_SIZE, end - i);
+            evaluateRange(camera, jacobianCalculator, transformedPoints, i, i + n,
+                    residual, computeJac ? jac.data() : NULL);
+            Map<VectorXd> res(residual, n);
+            blockCost += res.squaredNorm();
+            if (computeJac)
+            {
+                blockJtJ.noalias() += jac.topRows(n).transpose() * jac.topRows(n);
+                blockJtr.noalias() += jac.topRows(n).transpose() * res;
+            }
+        }
+        std::lock_guard<std::mutex> lock(sumMutex);
+        cost += blockCost;
+        if (computeJac)
+        {
+            *JtJ += blockJtJ;
+            *Jtr += blockJtr;
+        }
+    });
+    return 0.5 * cost;
+}
 
+PhotometricCostFunction * makePhotometricCostFunction(const ICamera * camera,
+        const Transf & xiBaseCam, const PhotometricPack & dataPack,
+        const Mat32f & img2, double scale)
+{
+    PhotometricCostFunction * costFunction = newCameraModel<PhotometricCostFunction,
+            ModelPhotometricCostFunction>(CameraModels(), camera, xiBaseCam, dataPack, img2, scale);
+    if (costFunction != NULL) return costFunction;
+    return new PhotometricCostFunction(camera, xiBaseCam, dataPack, img2, scale);
+}
 
 bool MonoReprojectCost::Evaluate(double const * const * params,
         double * residual, double ** jacobian) const
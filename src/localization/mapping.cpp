@@ -21,25 +21,44 @@ SLAM system
 
 #include "localization/mapping.h"
 
-
-//Speed estimation and extrapolation are to be added
 //Assumed that the data arrives in the chronological order
 PhotometricMapping::PhotometricMapping(const ptree & params):
     _params(params.get_child("mapping_parameters")),
+    //the radius of the distance check with K = 1, see selectMapFrames
+    _frameIndex(sqrt(5 * _params.distThreshSq)),
+    _frameDatabase(_params.residentKeyframes),
     _xiBaseCam( readTransform(params.get_child("xi_base_camera")) ),
     _sgmParams(params.get_child("stereo_parameters")),
     _camera( new EnhancedCamera(readVector<double>(params.get_child("camera_params")).data()) ),
     _sparseOdom(_camera, _xiBaseCam),
     _motionStereo(_camera, _camera, params.get_child("stereo_parameters")),
     _odomInit(false),
-    _localizer(5, _camera),
+    _depthChanged(true),
+    _localizer(NUM_SCALES, _camera),
     _xiLocal(0, 0, 0, 0, 0, 0),
     _zetaOdom(0, 0, 0, 0, 0, 0),
     _state(MAP_BEGIN),
-    _warningState(WARNING_NONE)
+    _warningState(WARNING_NONE),
+    _candidatePool(min(_params.relocalizationCandidates, numThreads()))
 {
     _localizer.setVerbosity(0);
     _localizer.setXiBaseCam(_xiBaseCam);
+    _localizer.setMaxPointNumber(_params.maxPhotometricPoints);
+    
+    if (not _params.keyframeDatabase.empty())
+    {
+        if (not _frameDatabase.open(_params.keyframeDatabase))
+        {
+            throw runtime_error("cannot open the keyframe database " + _params.keyframeDatabase);
+        }
+        for (int i = 0; i < _frameDatabase.size(); i++)
+        {
+            _frameVec.emplace_back();
+            _frameVec.back().xi = _frameDatabase.pose(i);
+            _frameIndex.insert(i, _frameVec.back().xi.trans());
+        }
+        cout << "KEYFRAMES LOADED : " << _frameVec.size() << endl;
+    }
 }
     
 bool PhotometricMapping::constructMap(const Transf & xiOdom, const Mat8u & img)
@@ -48,9 +67,7 @@ bool PhotometricMapping::constructMap(const Transf & xiOdom, const Mat8u & img)
     if (selectMapFrame(xiOdom, 1) == -1)
     {
     // insert a map keyframe
-        _frameVec.emplace_back();
-        img.copyTo(_frameVec.back().img);
-        _frameVec.back().xi = xiOdom;
+        pushMapFrame(img.clone(), xiOdom);
         
         cout << "KEYFRAME : " << endl;
         cout << "    " << xiOdom << endl;
@@ -77,25 +94,32 @@ const bool ODOM_MODE = false;
 
 void PhotometricMapping::feedImage(const Mat8u & img)
 {
+    //the features are computed once per image and shared by the localization,
+    //the stereo and the sparse odometry; the skipped images do not compute them
     bool interDistanceOk, mapDistanceOk;
     Transf xiMapFr;
     switch (_state)
     {
     case MAP_BEGIN:
+    {
         //store needed data for the initialization;
+        const FrameFeatures features(img, NUM_SCALES);
         _interFrame.xi = _xiLocal;
         _xiLocal = Transf(0, 0, 0, 0, 0, 0);
-        img.copyTo(_interFrame.img);
-        _sparseOdom.feedData(img, _xiLocal);
+        _interFrame.img = features.image();
+        _sparseOdom.feedData(features, _xiLocal);
         _state = MAP_INIT;
         break;
+    }
     case MAP_INIT:
+    {
         cout << "INIT" << endl;
         //check whether the init distance is enough;
         if (_xiLocal.trans().norm() < _params.minInitDist) break;
-        _sparseOdom.feedData(img, _xiLocal);
+        const FrameFeatures features(img, NUM_SCALES);
+        _sparseOdom.feedData(features, _xiLocal);
         _xiLocal = _sparseOdom.getIncrement();        
-        pushInterFrame(img);
+        pushInterFrame(features);
         
         _mapIdx = selectMapFrame(_interFrame.xi);
         
@@ -106,14 +130,17 @@ void PhotometricMapping::feedImage(const Mat8u & img)
         else
         {
             _state = MAP_LOCALIZE;
-            localizeMI();
+            localizeMI(features);
         }
         break;
+    }
     case MAP_LOCALIZE:
+    {
         cout << "LOCALIZE" << endl;
+        const FrameFeatures features(img, NUM_SCALES);
         //The area has been already mapped
         //localize wrt the intermediate frame
-        localizePhoto(img);
+        localizePhoto(features);
 
         //check the constraints
         
@@ -127,12 +154,12 @@ void PhotometricMapping::feedImage(const Mat8u & img)
         //TODO MI localization before recomputing the depth
         if (not mapDistanceOk) //need to change the map frame
         {
-            pushInterFrame(img);
+            pushInterFrame(features);
             int mapIdxOld = _mapIdx;
             _mapIdx = selectMapFrame(_interFrame.xi);
             if (_mapIdx != -1 and mapIdxOld != _mapIdx) 
             {
-                localizeMI();
+                localizeMI(features);
             }
             else if (_mapIdx == -1)
             {
@@ -142,58 +169,62 @@ void PhotometricMapping::feedImage(const Mat8u & img)
         }
         else if (not interDistanceOk)
         {
-            pushInterFrame(img);
-            localizeMI();
+            pushInterFrame(features);
+            localizeMI(features);
         }
         else
         {
-            improveStereo(img);
+            improveStereo(features);
         }
         break;
+    }
     case MAP_SLAM:
+    {
         cout << "SLAM" << endl;
+        const FrameFeatures features(img, NUM_SCALES);
         ///////localize with respect to the intermediate frame/////
-        localizePhoto(img);
+        localizePhoto(features);
         
         
         //////check the constraints/////
         if (not checkDistance(_xiLocal))
         {
-            pushInterFrame(img);
+            pushInterFrame(features);
 //            cout << " QUERY TRANSFORM : " <<  _interFrame.xi << endl;
             _mapIdx = selectMapFrame(_interFrame.xi);
             if (_mapIdx != -1 and not ODOM_MODE) //FIXME to test in ODOM mode
             { 
                 _state = MAP_LOCALIZE;
-                localizeMI();
+                localizeMI(features);
             }
         }
         else
         {
-            improveStereo(img);
+            improveStereo(features);
         }
         //if the inter frame is too far, push it into the map and 
         //init another intermediate frame
         break;
     }
+    }
 }
 
-void PhotometricMapping::improveStereo(const Mat8u & img)
+void PhotometricMapping::improveStereo(const FrameFeatures & features)
 {
     Transf base = getCameraMotion(_xiLocal);
     if (base.trans().norm() < _params.minStereoBase) return;
     
-    _depth = _motionStereo.compute(base, img, _depth);
+    _depth = _motionStereo.compute(base, features.image(), _depth);
     _depth.filterNoise();
+    _depthChanged = true;
 }
 
-void PhotometricMapping::pushInterFrame(const Mat8u & img)
+void PhotometricMapping::pushInterFrame(const FrameFeatures & features)
 {
+    //the images are never modified in place, so the frames share them
     if (_state == MAP_SLAM)
     {
-        _frameVec.emplace_back();
-        _interFrame.img.copyTo(_frameVec.back().img);
-        _frameVec.back().xi = _interFrame.xi;
+        pushMapFrame(_interFrame.img, _interFrame.xi);
     }
     
     Transf base = getCameraMotion(_xiLocal);
@@ -203,7 +234,7 @@ void PhotometricMapping::pushInterFrame(const Mat8u & img)
         //use the SGM to compute the depth estimate
         DepthMap newDepth;
         EnhancedSgm sgm(base.inverse(), _camera, _camera, _sgmParams);
-        sgm.computeStereo(img, _interFrame.img, newDepth);
+        sgm.computeStereo(features.image(), _interFrame.img, newDepth);
 //        imshow("img1", img);
 //        imshow("img2", _interFrame.img);
         cout << base.inverse() << endl;
@@ -244,14 +275,29 @@ void PhotometricMapping::pushInterFrame(const Mat8u & img)
         throw;
     }
     
-    img.copyTo(_interFrame.img);
+    _interFrame.img = features.image();
     _interFrame.xi = _interFrame.xi.compose(_xiLocal);
     _zetaOdom = _xiLocal;
-    _xiLocalOld = _xiLocal = Transf(0, 0, 0, 0, 0, 0);
-    
-    _localizer.setBaseImage(img);
-    _motionStereo.setBaseImage(img);
+    _xiLocalPrev = _xiLocalOld = _xiLocal = Transf(0, 0, 0, 0, 0, 0);
     
+    _localizer.setBaseImage(features);
+    _motionStereo.setBaseImage(features.image(), features.gradientMagnitude());
+    _depthChanged = true;
+}
+
+void PhotometricMapping::pushMapFrame(const Mat8u & img, const Transf & xi)
+{
+    _frameVec.emplace_back();
+    if (_frameDatabase.isOpen()) _frameDatabase.add(img, xi);
+    else _frameVec.back().img = img;
+    _frameVec.back().xi = xi;
+    _frameIndex.insert(_frameVec.size() - 1, xi.trans());
+}
+
+Mat8u PhotometricMapping::mapFrameImage(const int idx)
+{
+    if (_frameDatabase.isOpen()) return _frameDatabase.image(idx);
+    return _frameVec[idx].img;
 }
 
 Transf PhotometricMapping::getCameraMotion(const Transf & xi) const
@@ -263,21 +309,29 @@ void PhotometricMapping::reInit(const Transf & xi)
 {
     if (_state == MAP_SLAM)
     {
-        _frameVec.emplace_back();
-        _interFrame.img.copyTo(_frameVec.back().img);
-        _frameVec.back().xi = _interFrame.xi;
+        pushMapFrame(_interFrame.img, _interFrame.xi);
     }
     _state = MAP_BEGIN;
-    _xiLocalOld = _xiLocal = xi;
+    _xiLocalPrev = _xiLocalOld = _xiLocal = xi;
     _odomInit = false;
+    _motionModel.reset();
 }
 
 int PhotometricMapping::selectMapFrame(const Transf & xi, const double K)
 {
-    int res = -1;
-    double bestDist = DOUBLE_MAX;
+    vector<int> idxVec = selectMapFrames(xi, 1, K);
+    if (idxVec.empty()) return -1;
+    return idxVec.front();
+}
+
+vector<int> PhotometricMapping::selectMapFrames(const Transf & xi, const int maxNumber, const double K)
+{
+    vector<pair<double, int>> distVec;
     cout << "frame selection" << endl;
-    for (int i = 0; i < _frameVec.size(); i++)
+    //checkDistance bounds tx^2 / 5 + ty^2 + tz^2, so the matching frames are within
+    //this radius whatever the orientation, the exact check is done on the candidates only
+    const double radius = sqrt(5 * _params.distThreshSq * K);
+    for (int i : _frameIndex.radiusSearch(xi.trans(), radius))
     {
         Transf delta = xi.inverseCompose(_frameVec[i].xi);
 //        delta.trans()[1] = 0;
@@ -289,12 +343,14 @@ int PhotometricMapping::selectMapFrame(const Transf & xi, const double K)
 //        cout << "SELECT FRAME " << i << endl;
 //        cout << "    d : " << d << "    r : " << r << endl;
         if (not checkDistance(xi, _frameVec[i].xi, K)) continue;
-            
-        if (r + d < bestDist)
-        {
-            bestDist = r + d;
-            res = i;
-        }
+        distVec.emplace_back(r + d, i);
+    }
+    const int numSelected = min(maxNumber, int(distVec.size()));
+    std::partial_sort(distVec.begin(), distVec.begin() + numSelected, distVec.end());
+    vector<int> res;
+    for (int i = 0; i < numSelected; i++)
+    {
+        res.push_back(distVec[i].second);
     }
     return res;
 }
@@ -331,34 +387,143 @@ bool PhotometricMapping::checkDistance(const Transf & xi, const double K) const
             d < _params.distThreshSq * K);
 }
 
-Transf PhotometricMapping::localizeMI()
+Transf PhotometricMapping::localizeMI(const FrameFeatures & features)
 {
-    ScalePhotometric localizer(5, _camera); //TODO figure out why not _localizer
-    localizer.setVerbosity(0);
-    localizer.setXiBaseCam(_xiBaseCam);
-    localizer.setTargetImage(_frameVec[_mapIdx].img);
-    localizer.setBaseImage(_interFrame.img);
-    localizer.setDepth(_depth);
-    imshow("keyframe", _frameVec[_mapIdx].img);
+    //_mapIdx goes first, the other candidates are the closest frames
+    vector<int> candidateVec(1, _mapIdx);
+    for (int idx : selectMapFrames(_interFrame.xi, _params.relocalizationCandidates))
+    {
+        if (idx != _mapIdx and int(candidateVec.size()) < _params.relocalizationCandidates)
+        {
+            candidateVec.push_back(idx);
+        }
+    }
+    const int NUM_CANDIDATES = candidateVec.size();
+    
+    //the base data is the same for all the candidates, it is built once and shared,
+    //the pyramid is the one pushInterFrame has built;
+    //the candidates are compared by the mutual information without the prior
+    ScalePhotometric baseLocalizer(NUM_SCALES, _camera);
+    baseLocalizer.setVerbosity(0);
+    baseLocalizer.setXiBaseCam(_xiBaseCam);
+    baseLocalizer.setBaseImage(features);
+    baseLocalizer.setDepth(_depth);
+    baseLocalizer.buildPhotometricData();
+    //the database is not thread-safe
+    vector<Mat8u> candidateImgVec;
+    vector<std::unique_ptr<ScalePhotometric>> localizerVec;
+    for (int idx : candidateVec)
+    {
+        candidateImgVec.push_back(mapFrameImage(idx));
+        localizerVec.emplace_back(new ScalePhotometric(NUM_SCALES, _camera)); //TODO figure out why not _localizer
+        localizerVec.back()->setVerbosity(0);
+        localizerVec.back()->setTargetImage(candidateImgVec.back());
+        localizerVec.back()->setBaseData(baseLocalizer);
+    }
+    const Transf & xiFr = _interFrame.xi;
+    vector<Transf> xiFrMapVec(NUM_CANDIDATES);
+    vector<PoseEstimationSummary> summaryVec(NUM_CANDIDATES);
+    for (int i = 0; i < NUM_CANDIDATES; i++)
+    {
+        const Transf & xiMap = _frameVec[candidateVec[i]].xi;
+        xiFrMapVec[i] = xiFr.inverseCompose(xiMap);
+        localizerVec[i]->startPoseMI(xiFrMapVec[i], summaryVec[i]);
+    }
+    
+    //all the candidates go through a scale before they are compared at it,
+    //so the cancellation does not depend on the timing of the threads;
+    //a candidate is active until it is cancelled or runs out of time
+    vector<int> activeVec;
+    for (int i = 0; i < NUM_CANDIDATES; i++) activeVec.push_back(i);
+    for (int scaleIdx = NUM_SCALES - 1; scaleIdx >= 0 and not activeVec.empty(); scaleIdx--)
+    {
+        vector<uint8_t> doneVec(NUM_CANDIDATES, 0);
+        _candidatePool.run(activeVec.size(), [&](const int j)
+        {
+            const int i = activeVec[j];
+            doneVec[i] = localizerVec[i]->stepPoseMI(scaleIdx, xiFrMapVec[i], _zetaOdom,
+                    _params.relocalizationTimeBudget, summaryVec[i]);
+        });
+        
+        double bestCost = DOUBLE_INF;
+        for (int i : activeVec)
+        {
+            if (doneVec[i]) bestCost = min(bestCost, summaryVec[i].dataCost);
+        }
+        vector<int> nextActiveVec;
+        for (int i : activeVec)
+        {
+            if (not doneVec[i]) continue;
+            //the coarsest scale is too ambiguous to discard a candidate
+            if (scaleIdx < NUM_SCALES - 1 and summaryVec[i].dataCost - bestCost
+                    > _params.candidateCancelMargin * abs(bestCost))
+            {
+                summaryVec[i].cancelled = true;
+                continue;
+            }
+            nextActiveVec.push_back(i);
+        }
+        activeVec.swap(nextActiveVec);
+    }
+    
+    //the candidates which have reached the finest scale go first, then the lowest cost,
+    //the ties are broken by the candidate order
+    int bestIdx = 0;
+    for (int i = 1; i < NUM_CANDIDATES; i++)
+    {
+        const PoseEstimationSummary & best = summaryVec[bestIdx];
+        const PoseEstimationSummary & current = summaryVec[i];
+        if (current.cancelled) continue;
+        if (best.cancelled or current.processedScales > best.processedScales
+                or (current.processedScales == best.processedScales
+                    and current.dataCost < best.dataCost))
+        {
+            bestIdx = i;
+        }
+    }
+    if (NUM_CANDIDATES > 1)
+    {
+        cout << "CANDIDATES" << endl;
+        for (int i = 0; i < NUM_CANDIDATES; i++)
+        {
+            cout << "    " << candidateVec[i] << "    cost : " << summaryVec[i].dataCost
+                    << (summaryVec[i].cancelled ? "    cancelled" : "") << endl;
+        }
+    }
+    
+    _mapIdx = candidateVec[bestIdx];
+    imshow("keyframe", candidateImgVec[bestIdx]);
     cout << "KF TRANSFORM" << endl;
     cout << _frameVec[_mapIdx].xi << endl;
 //    waitKey(0);
-    Transf & xiFr = _interFrame.xi;
     const Transf & xiMap = _frameVec[_mapIdx].xi;
-//    Transf xiFrMap = localizer.computePoseMI(xiFr.inverseCompose(xiMap));
-    Transf xiFrMap = localizer.computePoseMI(xiFr.inverseCompose(xiMap), _zetaOdom);
-    xiFr = xiMap.composeInverse(xiFrMap);
+    _interFrame.xi = xiMap.composeInverse(xiFrMapVec[bestIdx]);
+    return _interFrame.xi;
 }
 
-Transf PhotometricMapping::localizePhoto(const Mat8u & img)
+Transf PhotometricMapping::localizePhoto(const FrameFeatures & features)
 {
-    _localizer.setDepth(_depth);
-    _localizer.setTargetImage(img);
+    // the photometric data of the localizer is rebuilt only if the depth has changed
+    if (_depthChanged)
+    {
+        _localizer.setDepth(_depth);
+        _depthChanged = false;
+    }
+    _localizer.setTargetImage(features);
     
     //estimated using only wheel odometry measurements
     Transf zetaPrior = _xiLocalOld.inverseCompose(_xiLocal);
+    //the odometry prior stays centred on it when the initial guess is predicted
+    const Transf xiLocalOdom = _xiLocal;
     
-    _xiLocal = _localizer.computePose( _xiLocal );
+    if (_params.motionPrediction)
+    {
+        MotionPrediction prediction = _motionModel.predict(_xiLocalPrev.inverseCompose(_xiLocal));
+        _xiLocal = _xiLocalPrev.compose(prediction.zeta);
+        _localizer.setCoarsestScale(predictionScale(prediction));
+    }
+    
+    _xiLocal = _localizer.computePose( _xiLocal, xiLocalOdom );
     
 //    _xiLocal = _localizer.computePoseMI( _xiLocal );
     
@@ -457,6 +622,25 @@ Transf PhotometricMapping::localizePhoto(const Mat8u & img)
         }
         _xiLocalOld = _xiLocal;
     }
+    
+    _motionModel.update(_xiLocalPrev.inverseCompose(_xiLocal));
+    _xiLocalPrev = _xiLocal;
+}
+
+int PhotometricMapping::predictionScale(const MotionPrediction & prediction) const
+{
+    //3-sigma pixel error of a point in front of the camera
+    const double & fu = _camera->getParams()[2];
+    const double sigmaPix = 3 * fu * (prediction.sigma.tail<3>().norm() 
+            + prediction.sigma.head<3>().norm() / _params.predictionDepth);
+    if (not std::isfinite(sigmaPix) or _params.convergenceRadius <= 0) return NUM_SCALES - 1;
+    //the pixels of the scale k are 2^k times larger
+    int scaleIdx = 0;
+    while (scaleIdx < NUM_SCALES - 1 and sigmaPix > _params.convergenceRadius * (1 << scaleIdx))
+    {
+        scaleIdx++;
+    }
+    return scaleIdx;
 }
 
 
@@ -38,7 +38,7 @@ MonoOdometry::MonoOdometry(const ptree & params):
     _camera( new EnhancedCamera(readVector<double>(params.get_child("camera_params")).data()) ),
     sparseOdom(_camera, _xiBaseCam),
     motionStereo(_camera, _camera, params.get_child("stereo_parameters")),
-    localizer(5, _camera),
+    localizer(NUM_SCALES, _camera),
     state(STATE_BEGIN)
 {
     cout << "verbosity " << _sgmParams.verbosity << endl; 
@@ -83,16 +83,19 @@ void MonoOdometry::feedImage(const Mat8u & imageNew)
     switch (state)
     {
     case STATE_BEGIN:
+    {
         //the starting point, position 0
         //TODO refactor
         _xiGlobal = _xiLocal = Transf(0, 0, 0, 0, 0, 0);
-        imageVec.emplace_back(imageNew.clone());
+        const FrameFeatures features(imageNew, NUM_SCALES);
+        imageVec.push_back(features.image());
         transfVec.push_back(_xiLocal);
-        motionStereo.setBaseImage(imageNew);
-        sparseOdom.feedData(imageNew, _xiLocal);
-        localizer.setBaseImage(imageNew);
+        motionStereo.setBaseImage(features.image(), features.gradientMagnitude());
+        sparseOdom.feedData(features, _xiLocal);
+        localizer.setBaseImage(features);
         state = STATE_SPARSE_INIT;   
         break;    
+    }
     case STATE_SPARSE_INIT:
         //wait until the distance is sucfficient to do the saprce initialization
 //        motionStereo.setBaseImage(imageNew);
@@ -208,9 +211,10 @@ void MonoOdometry::pushKeyFrame(const Mat8u & imageNew)
     
     //reset the local position
     _xiLocal = Transf(0, 0, 0, 0, 0, 0);
-    imageVec.emplace_back(imageNew.clone());
-    localizer.setBaseImage(imageNew);
-    motionStereo.setBaseImage(imageNew);
+    const FrameFeatures features(imageNew, NUM_SCALES);
+    imageVec.push_back(features.image());
+    localizer.setBaseImage(features);
+    motionStereo.setBaseImage(features.image(), features.gradientMagnitude());
     //Project the depth forward
     
 }
@@ -0,0 +1,97 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/ 
+
+/*
+Motion prediction for the photometric localization
+*/
+
+#include "localization/motion_model.h"
+
+#include "std.h"
+#include "eigen.h"
+
+#include "geometry/geometry.h"
+
+MotionModel::MotionModel(double errV, double errW, double sigmaT, double sigmaR) :
+        _errV(errV), _errW(errW),
+        _sigmaT(sigmaT), _sigmaR(sigmaR)
+{
+    reset();
+}
+
+void MotionModel::reset()
+{
+    _velocity.setZero();
+    _accelerationVar.setZero();
+    _numUpdates = 0;
+}
+
+Vector6d MotionModel::odometryVariance(const Transf & zetaOdom) const
+{
+    const double sigmaT = _errV * zetaOdom.trans().norm() + _sigmaT;
+    const double sigmaR = _errW * zetaOdom.rot().norm() + _sigmaR;
+    Vector6d var;
+    var << Vector3d::Constant(sigmaT * sigmaT), Vector3d::Constant(sigmaR * sigmaR);
+    return var;
+}
+
+MotionPrediction MotionModel::predict(const Transf & zetaOdom) const
+{
+    MotionPrediction prediction;
+    const Vector6d varOdom = odometryVariance(zetaOdom);
+    
+    // the acceleration variance is unknown until two increments have been observed
+    if (_numUpdates < 2)
+    {
+        prediction.zeta = zetaOdom;
+        prediction.sigma = varOdom.cwiseSqrt();
+        return prediction;
+    }
+    
+    Vector6d xOdom;
+    zetaOdom.toArray(xOdom.data());
+    
+    // the floors keep the weights finite for a perfectly steady motion
+    Vector6d floorVar;
+    floorVar << Vector3d::Constant(_sigmaT * _sigmaT), Vector3d::Constant(_sigmaR * _sigmaR);
+    const Vector6d varVelocity = _accelerationVar + floorVar;
+    
+    const Vector6d infoOdom = varOdom.cwiseInverse();
+    const Vector6d infoVelocity = varVelocity.cwiseInverse();
+    const Vector6d var = (infoOdom + infoVelocity).cwiseInverse();
+    const Vector6d x = var.cwiseProduct(infoOdom.cwiseProduct(xOdom) + infoVelocity.cwiseProduct(_velocity));
+    
+    prediction.zeta = Transf(x.data());
+    prediction.sigma = var.cwiseSqrt();
+    return prediction;
+}
+
+void MotionModel::update(const Transf & zeta)
+{
+    Vector6d x;
+    zeta.toArray(x.data());
+    if (_numUpdates > 0)
+    {
+        const Vector6d delta = x - _velocity;
+        const Vector6d deltaSq = delta.cwiseProduct(delta);
+        if (_numUpdates == 1) _accelerationVar = deltaSq;
+        else _accelerationVar += ACCELERATION_DECAY * (deltaSq - _accelerationVar);
+    }
+    _velocity = x;
+    _numUpdates++;
+}
+
@@ -17,6 +17,8 @@ along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "localization/photometric.h"
 
+#include <memory>
+
 #include "io.h"
 #include "std.h"
 #include "eigen.h"
@@ -30,6 +32,7 @@ void ScalePhotometric::setBaseImage(const Mat8u & img1)
 {
     if (verbosity > 0) cout << "ScalePhotometric::computeBaseScaleSpace" << endl;
     scaleSpace1.generate(img1);
+    invalidatePhotometricData();
 }
 
 void ScalePhotometric::setTargetImage(const Mat8u & img2)
@@ -38,11 +41,121 @@ void ScalePhotometric::setTargetImage(const Mat8u & img2)
     scaleSpace2.generate(img2);
 }
 
+void ScalePhotometric::setBaseImage(const FrameFeatures & features1)
+{
+    if (verbosity > 0) cout << "ScalePhotometric::setBaseImage with FrameFeatures" << endl;
+    if (features1.pyramid().size() == scaleSpace1.size()) scaleSpace1 = features1.pyramid();
+    else scaleSpace1.generate(features1.image());
+    invalidatePhotometricData();
+}
+
+void ScalePhotometric::setTargetImage(const FrameFeatures & features2)
+{
+    if (verbosity > 0) cout << "ScalePhotometric::setTargetImage with FrameFeatures" << endl;
+    if (features2.pyramid().size() == scaleSpace2.size()) scaleSpace2 = features2.pyramid();
+    else scaleSpace2.generate(features2.image());
+}
+
+void ScalePhotometric::buildPhotometricData()
+{
+    for (int scaleIdx = 0; scaleIdx < scaleSpace1.size(); scaleIdx++)
+    {
+        getPhotometricData(scaleIdx);
+    }
+}
+
+void ScalePhotometric::setBaseData(const ScalePhotometric & source)
+{
+    if (verbosity > 0) cout << "ScalePhotometric::setBaseData" << endl;
+    assert(source._packVec.size() == source.scaleSpace1.size());
+    scaleSpace1 = source.scaleSpace1;
+    _xiBaseCam = source._xiBaseCam;
+    _packVec = source._packVec;
+}
+
 void ScalePhotometric::setMotionPriorStatus(const bool val)
 {
     useMotionPrior = val;
 }
 
+void ScalePhotometric::subsampleCandidates(const int cols, const int rows)
+{
+    const int N = _candidateIdxVec.size();
+    if (maxPointNumber <= 0 or N <= maxPointNumber) return;
+    
+    // candidates of each cell, sorted by decreasing gradient
+    const int cellCols = (cols + CELL_SIZE - 1) / CELL_SIZE;
+    const int cellRows = (rows + CELL_SIZE - 1) / CELL_SIZE;
+    vector<vector<int>> cellVec(cellCols * cellRows);
+    for (int i = 0; i < N; i++)
+    {
+        const int & idx = _candidateIdxVec[i];
+        const int cellIdx = (idx / cols / CELL_SIZE) * cellCols + (idx % cols) / CELL_SIZE;
+        cellVec[cellIdx].push_back(i);
+    }
+    auto stronger = [this](const int a, const int b) { return _candidateGradVec[a] > _candidateGradVec[b]; };
+    for (auto & cell : cellVec)
+    {
+        sort(cell.begin(), cell.end(), stronger);
+    }
+    
+    // the largest quota per cell which fits into the budget
+    auto countSelected = [&cellVec](const int quota)
+    {
+        int count = 0;
+        for (auto & cell : cellVec) count += min(quota, int(cell.size()));
+        return count;
+    };
+    int quota = 0, quotaMax = N;
+    while (quotaMax - quota > 1)
+    {
+        const int mid = (quota + quotaMax) / 2;
+        if (countSelected(mid) <= maxPointNumber) quota = mid;
+        else quotaMax = mid;
+    }
+    
+    // the rest of the budget goes to the best candidates of the next rank
+    vector<int> selectedVec, nextRankVec;
+    selectedVec.reserve(maxPointNumber);
+    for (auto & cell : cellVec)
+    {
+        const int n = min(quota, int(cell.size()));
+        selectedVec.insert(selectedVec.end(), cell.begin(), cell.begin() + n);
+        if (cell.size() > quota) nextRankVec.push_back(cell[quota]);
+    }
+    const int rest = min(maxPointNumber - int(selectedVec.size()), int(nextRankVec.size()));
+    std::partial_sort(nextRankVec.begin(), nextRankVec.begin() + rest, nextRankVec.end(), stronger);
+    selectedVec.insert(selectedVec.end(), nextRankVec.begin(), nextRankVec.begin() + rest);
+    
+    // the original order is kept
+    sort(selectedVec.begin(), selectedVec.end());
+    for (int i = 0; i < selectedVec.size(); i++)
+    {
+        _candidatePointVec[i] = _candidatePointVec[selectedVec[i]];
+        _candidateIdxVec[i] = _candidateIdxVec[selectedVec[i]];
+        _candidateGradVec[i] = _candidateGradVec[selectedVec[i]];
+        _candidateDepthVec[i] = _candidateDepthVec[selectedVec[i]];
+    }
+    _candidatePointVec.resize(selectedVec.size());
+    _candidateIdxVec.resize(selectedVec.size());
+    _candidateGradVec.resize(selectedVec.size());
+    _candidateDepthVec.resize(selectedVec.size());
+}
+
+const PhotometricPack & ScalePhotometric::getPhotometricData(int scaleIdx)
+{
+    if (_packVec.size() != scaleSpace1.size())
+    {
+        _packVec.assign(scaleSpace1.size(), NULL);
+    }
+    if (not _packVec[scaleIdx])
+    {
+        _packVec[scaleIdx] = std::make_shared<const PhotometricPack>(initPhotometricData(scaleIdx));
+    }
+    scaleSpace1.setActiveScale(scaleIdx);
+    return *_packVec[scaleIdx];
+}
+
 PhotometricPack ScalePhotometric::initPhotometricData(int scaleIdx)
 {
     if (verbosity > 2) cout << "ScalePhotometric::initPhotometricData" << endl;
@@ -53,74 +166,224 @@ PhotometricPack ScalePhotometric::initPhotometricData(int scaleIdx)
     const Mat32f & gradU1 = scaleSpace1.getGradU();
     const Mat32f & gradV1 = scaleSpace1.getGradV();
     double scale = scaleSpace1.getActiveScale();
-    vector<double> valVec;
-    vector<int> packIdxVec;
-    vector<Vector2d> imagePointVec;
+    // the query and the selected pixels are kept in the members to avoid reallocations
+    _candidatePointVec.clear();
+    _candidateIdxVec.clear();
+    _candidateGradVec.clear();
+    _candidateDepthVec.clear();
     if (verbosity > 3) cout << "    scaled image size : " << img1.size() << endl;
+    
+    // the pixel ranges [begin, end) whose nearest depth cell is in the column x or the row y
+    vector<int> colBeginVec(depthMap.xMax, 0), colEndVec(depthMap.xMax, 0);
+    vector<int> rowBeginVec(depthMap.yMax, 0), rowEndVec(depthMap.yMax, 0);
+    for (int us = 0; us < img1.cols; us++)
+    {
+        const int x = depthMap.xConv(scaleSpace1.uConv(us));
+        if (x < 0 or x >= depthMap.xMax) continue;
+        if (colBeginVec[x] == colEndVec[x]) colBeginVec[x] = us;
+        colEndVec[x] = us + 1;
+    }
     for (int vs = 0; vs < img1.rows; vs++)
     {
-        for (int us = 0; us < img1.cols; us++)
+        const int y = depthMap.yConv(scaleSpace1.vConv(vs));
+        if (y < 0 or y >= depthMap.yMax) continue;
+        if (rowBeginVec[y] == rowEndVec[y]) rowBeginVec[y] = vs;
+        rowEndVec[y] = vs + 1;
+    }
+    
+    // only the pixels which fall into valid depth cells are tested,
+    // the sparse form is built once per depth map and shared by all the scales
+    if (not _sparseDepthValid)
+    {
+        depthMap.toSparse(_sparseDepth);
+        _sparseDepthValid = true;
+    }
+    for (int i = 0; i < _sparseDepth.size(); i++)
+    {
+        if (_sparseDepth.depth(i) > DIST_MAX) continue;
+        const int x = _sparseDepth.x(i);
+        const int y = _sparseDepth.y(i);
+        for (int vs = rowBeginVec[y]; vs < rowEndVec[y]; vs++)
         {
-            double gu = gradU1(vs, us);
-            double gv = gradV1(vs, us);
-            if (gu*gu + gv*gv < GRAD_THRESH) continue; 
-            
-            //TODO change the threshold depending on the image size or use adaptive random sampling
-            // to speed up the computation
-            int ub = scaleSpace1.uConv(us);
-            int vb = scaleSpace1.vConv(vs);
-            if (depthMap.nearest(ub, vb) > DIST_MAX
-                or depthMap.nearest(ub, vb) == OUT_OF_RANGE
-                or img1(vs, us) > 240
-                ) continue;
-            
-            if (verbosity > 4) cout << "    " << vs << " " << us << endl;
-            valVec.push_back(img1(vs, us));
-            imagePointVec.emplace_back(ub, vb);
-            packIdxVec.push_back(vs*img1.cols + us);
+            for (int us = colBeginVec[x]; us < colEndVec[x]; us++)
+            {
+                double gu = gradU1(vs, us);
+                double gv = gradV1(vs, us);
+                const double gradSq = gu*gu + gv*gv;
+                if (gradSq < GRAD_THRESH or img1(vs, us) > 240) continue; 
+                
+                if (verbosity > 4) cout << "    " << vs << " " << us << endl;
+                _candidatePointVec.emplace_back(scaleSpace1.uConv(us), scaleSpace1.vConv(vs));
+                _candidateIdxVec.push_back(vs*img1.cols + us);
+                _candidateGradVec.push_back(gradSq);
+                _candidateDepthVec.push_back(_sparseDepth.depth(i));
+            }
         }
     }
-    vector<int> reconstIdxVec;
-    depthMap.reconstruct(imagePointVec, reconstIdxVec, dataPack.cloud);
-    _xiBaseCam.transform(dataPack.cloud, dataPack.cloud);
-    for (auto & idx : reconstIdxVec)
+    subsampleCandidates(img1.cols, img1.rows);
+    
+    // the depth of every candidate comes from its sparse cell, the dense map is not queried
+    dataPack.cloud.reserve(_candidatePointVec.size());
+    dataPack.idxVec.reserve(_candidatePointVec.size());
+    dataPack.valVec.reserve(_candidatePointVec.size());
+    for (int i = 0; i < _candidatePointVec.size(); i++)
     {
-        dataPack.idxVec.push_back(packIdxVec[idx]);
-        dataPack.valVec.push_back(valVec[idx]);
+        Vector3d X;
+        if (not depthMap.reconstructBearing(_candidatePointVec[i], X)) continue;
+        dataPack.cloud.push_back(X * _candidateDepthVec[i]);
+        const int packIdx = _candidateIdxVec[i];
+        dataPack.idxVec.push_back(packIdx);
+        dataPack.valVec.push_back(img1(packIdx / img1.cols, packIdx % img1.cols));
     }
-    if (verbosity > 3) cout << "    datapack size : " << reconstIdxVec.size() << endl;
+    _xiBaseCam.transform(dataPack.cloud, dataPack.cloud);
+    if (verbosity > 3) cout << "    datapack size : " << dataPack.idxVec.size() << endl;
     return dataPack;
 }
 
 Transf ScalePhotometric::computePose(const Transf & T12)
+{
+    PoseEstimationSummary summary;
+    return computePose(T12, 0, summary);
+}
+
+Transf ScalePhotometric::computePose(const Transf & T12, const Transf & xiPrior)
+{
+    PoseEstimationSummary summary;
+    return computePose(T12, xiPrior, 0, summary);
+}
+
+Transf ScalePhotometric::computePose(const Transf & T12, double timeBudget,
+        PoseEstimationSummary & summary)
+{
+    return computePose(T12, T12, timeBudget, summary);
+}
+
+Transf ScalePhotometric::computePose(const Transf & T12, const Transf & xiPrior, double timeBudget,
+        PoseEstimationSummary & summary)
 {
     if (verbosity > 0) 
     {
         cout << "ScalePhotometric::computePose" << endl;
     }
+    Timer timer;
+    summary = PoseEstimationSummary();
     //TODO set the optimization depth with the parameters   v
     Transf xi = T12;
-    _xiPrior = T12;
-    for (int scaleIdx = scaleSpace1.size() - 1; scaleIdx >= 0; scaleIdx--)
+    _xiPrior = xiPrior;
+    for (int scaleIdx = firstScale(); scaleIdx >= 0; scaleIdx--)
     {
-        computePose(scaleIdx, xi);
+        const double maxTime = scaleTimeBudget(timer.elapsed(), timeBudget, scaleIdx, summary);
+        if (maxTime < 0) break;
+        computePose(scaleIdx, xi, maxTime, summary);
     }
+    summary.elapsedTime = timer.elapsed();
     return xi;
 }
 
-void ScalePhotometric::computePose(int scaleIdx, Transf & T12)
+int ScalePhotometric::firstScale() const
+{
+    if (coarsestScale < 0) return scaleSpace1.size() - 1;
+    return min(coarsestScale, scaleSpace1.size() - 1);
+}
+
+double ScalePhotometric::scaleTimeBudget(double elapsedTime, double timeBudget, int scaleIdx,
+        PoseEstimationSummary & summary) const
+{
+    if (timeBudget <= 0) return 0;
+    const double remainingTime = timeBudget - elapsedTime;
+    if (remainingTime <= 0)
+    {
+        summary.deadlineReached = true;
+        return -1;
+    }
+    // an iteration costs in proportion to the number of pixels of the scale,
+    // so the remaining time is shared between the remaining scales with these weights;
+    // the time not used by the coarse scales goes to the fine ones
+    double remainingPixels = 0;
+    for (int k = 0; k <= scaleIdx; k++) remainingPixels += scaleSpace2.pixelCount(k);
+    if (remainingPixels == 0) return remainingTime / (scaleIdx + 1);
+    return remainingTime * scaleSpace2.pixelCount(scaleIdx) / remainingPixels;
+}
+
+void ScalePhotometric::computePose(int scaleIdx, Transf & T12, double maxTime,
+        PoseEstimationSummary & summary)
 {
     if (verbosity > 1) 
     {
         cout << "ScalePhotometric::computePose with scaleIdx = " << scaleIdx << endl;
     }
-    PhotometricPack dataPack = initPhotometricData(scaleIdx);
+    // the data preparation counts in maxTime
+    Timer timer;
+    auto remainingTime = [&]() { return maxTime > 0 ? max(maxTime - timer.elapsed(), 1e-6) : 0.; };
+    summary.processedScales++;
+    const PhotometricPack & dataPack = getPhotometricData(scaleIdx);
     scaleSpace2.setActiveScale(scaleIdx);
+    if (useInverseCompositional)
+    {
+        // getPhotometricData has set the active scale of scaleSpace1
+        InverseCompositionalAlignment alignment(camPtr2, _xiBaseCam, dataPack,
+                scaleSpace1.getGradU(), scaleSpace1.getGradV(), scaleSpace1.getActiveScale());
+        PoseSolverSummary alignSummary = alignment.align(T12, scaleSpace2.get(), remainingTime());
+        if (verbosity > 1)
+        {
+            cout << "InverseCompositionalAlignment: " << alignSummary.iterations << " iterations" << endl;
+        }
+        summary.iterations += alignSummary.iterations;
+        summary.finalCost = alignSummary.finalCost;
+        summary.converged = summary.converged and alignSummary.converged;
+        summary.deadlineReached = summary.deadlineReached or alignSummary.timeLimitReached;
+        return;
+    }
     array<double, 6> pose = T12.toArray();
-    Problem problem;
-    PhotometricCostFunction * costFunction = new PhotometricCostFunction(camPtr2, _xiBaseCam, dataPack,
-                                            scaleSpace2.get(), scaleSpace2.getActiveScale());
+    std::unique_ptr<PhotometricCostFunction> costFunction(makePhotometricCostFunction(camPtr2,
+            _xiBaseCam, dataPack, scaleSpace2.get(), scaleSpace2.getActiveScale()));
+    
+    //add an odometry prior
+    std::unique_ptr<OdometryPrior> odometryCost;
+    if (useMotionPrior) //FIXME experimental
+    {
+        //A proper nose model on the depth map localization must be applied
+        odometryCost.reset(new OdometryPrior(0.03, 0.03, 0.01, 0.01, _xiPrior));
+    }
+    
+    // the same problem, without materializing the jacobian
+    if (useDirectSolver)
+    {
+        PoseSolverOptions solverOptions;
+        solverOptions.verbose = (verbosity > 2);
+        solverOptions.maxTime = remainingTime();
+        PoseSolver solver(solverOptions);
+        solver.addTerm(costFunction.get());
+        std::unique_ptr<DenseNormalEquationTerm> priorTerm;
+        if (odometryCost)
+        {
+            priorTerm.reset(new DenseNormalEquationTerm(odometryCost.get()));
+            solver.addTerm(priorTerm.get());
+        }
+        array<double, 6> directPose = pose;
+        PoseSolverSummary solverSummary = solver.solve(directPose.data());
+        if (verbosity > 1)
+        {
+            cout << "PoseSolver: " << solverSummary.iterations << " iterations, cost "
+                    << solverSummary.initialCost << " -> " << solverSummary.finalCost << endl;
+        }
+        summary.iterations += solverSummary.iterations;
+        // only the failure of the damping is worth the fallback, ceres would not do better
+        // within the same number of iterations and there is no time left after the deadline
+        if (solverSummary.converged or solverSummary.timeLimitReached
+                or solverSummary.iterations >= solverOptions.maxIterations)
+        {
+            T12 = Transf(directPose.data());
+            summary.finalCost = solverSummary.finalCost;
+            summary.converged = summary.converged and solverSummary.converged;
+            summary.deadlineReached = summary.deadlineReached or solverSummary.timeLimitReached;
+            return;
+        }
+        if (verbosity > 0) cout << "PoseSolver has not converged, falling back to ceres" << endl;
+    }
     
+    // the problem takes the ownership of the cost functions
+    Problem problem;
     const double LOSS_THRESH = 10;
 //    RobustLoss myLoss(LOSS_THRESH);
 //    CauchyLoss myLoss(LOSS_THRESH);
@@ -134,59 +397,101 @@ void ScalePhotometric::computePose(int scaleIdx, Transf & T12)
     
 //    problem.AddResidualBlock(costFunction, new RobustLoss(LOSS_THRESH), pose.data());
 //    problem.AddResidualBlock(costFunction, new CauchyLoss(LOSS_THRESH), pose.data());
-    problem.AddResidualBlock(costFunction, NULL, pose.data());    
-    
-    //add an odometry prior
-    if (useMotionPrior) //FIXME experimental
+    problem.AddResidualBlock(costFunction.release(), NULL, pose.data());
+    if (odometryCost)
     {
-        //A proper nose model on the depth map localization must be applied
-        OdometryPrior * odometryCost = new OdometryPrior(0.03, 0.03, 0.01, 0.01, _xiPrior);
-        problem.AddResidualBlock(odometryCost, NULL, pose.data());
+        problem.AddResidualBlock(odometryCost.release(), NULL, pose.data());
     }
     
     //run the solver
     Solver::Options options;
     options.linear_solver_type = ceres::DENSE_QR;
     options.max_num_iterations = 150;
+    if (maxTime > 0) options.max_solver_time_in_seconds = remainingTime();
     if (verbosity > 2) options.minimizer_progress_to_stdout = true;
-    Solver::Summary summary;
-    Solve(options, &problem, &summary);
-    if (verbosity > 2) cout << summary.FullReport() << endl;
-    else if (verbosity > 1) cout << summary.BriefReport() << endl;
+    Solver::Summary solverSummary;
+    Solve(options, &problem, &solverSummary);
+    if (verbosity > 2) cout << solverSummary.FullReport() << endl;
+    else if (verbosity > 1) cout << solverSummary.BriefReport() << endl;
     T12 = Transf(pose.data());
+    summary.iterations += solverSummary.iterations.size();
+    summary.finalCost = solverSummary.final_cost;
+    summary.converged = summary.converged and solverSummary.termination_type == ceres::CONVERGENCE;
+    if (maxTime > 0 and timer.elapsed() >= maxTime) summary.deadlineReached = true;
 }
 
 Transf ScalePhotometric::computePoseMI(const Transf & T12)
+{
+    PoseEstimationSummary summary;
+    return computePoseMI(T12, 0, summary);
+}
+
+Transf ScalePhotometric::computePoseMI(const Transf & T12, double timeBudget,
+        PoseEstimationSummary & summary)
 {
     if (verbosity > 0) 
     {
         cout << "ScalePhotometric::computePoseMI" << endl;
     }
+    Timer timer;
+    summary = PoseEstimationSummary();
     Transf xi = T12;
     //TODO set the optimization depth with the parameters   v
     for (int scaleIdx = scaleSpace1.size() - 1; scaleIdx >= 0; scaleIdx--)
     {
-        computePoseMI(scaleIdx, xi);
+        const double maxTime = scaleTimeBudget(timer.elapsed(), timeBudget, scaleIdx, summary);
+        if (maxTime < 0) break;
+        computePoseMI(scaleIdx, xi, maxTime, summary);
     }
+    summary.elapsedTime = timer.elapsed();
     return xi;
 }
 
 Transf ScalePhotometric::computePoseMI(const Transf & T12, const Transf & Todom)
+{
+    PoseEstimationSummary summary;
+    return computePoseMI(T12, Todom, 0, ScaleCallback(), summary);
+}
+
+Transf ScalePhotometric::computePoseMI(const Transf & T12, const Transf & Todom, double timeBudget,
+        const ScaleCallback & callback, PoseEstimationSummary & summary)
 {
     if (verbosity > 0) 
     {
         cout << "ScalePhotometric::computePoseMI" << endl;
     }
+    startPoseMI(T12, summary);
     Transf xi = T12;
-    _xiPrior = T12;
     //TODO set the optimization depth with the parameters   v
     for (int scaleIdx = scaleSpace1.size() - 1; scaleIdx >= 0; scaleIdx--)
     {
-        computePoseMI(scaleIdx, xi, Todom);
+        if (not stepPoseMI(scaleIdx, xi, Todom, timeBudget, summary)) break;
+        if (callback and not callback(scaleIdx, summary.dataCost))
+        {
+            summary.cancelled = true;
+            break;
+        }
     }
     return xi;
 }
 
+void ScalePhotometric::startPoseMI(const Transf & T12, PoseEstimationSummary & summary)
+{
+    summary = PoseEstimationSummary();
+    _xiPrior = T12;
+}
+
+bool ScalePhotometric::stepPoseMI(int scaleIdx, Transf & T12, const Transf & Todom,
+        double timeBudget, PoseEstimationSummary & summary)
+{
+    Timer timer;
+    const double maxTime = scaleTimeBudget(summary.elapsedTime, timeBudget, scaleIdx, summary);
+    if (maxTime < 0) return false;
+    computePoseMI(scaleIdx, T12, Todom, maxTime, summary);
+    summary.elapsedTime += timer.elapsed();
+    return true;
+}
+
 //TODO put to a separate file   
 void saveSurface(string fileName, FirstOrderFunction * func, 
         int idx1, int idx2, double step, int Nsteps, double* params)
@@ -212,18 +517,18 @@ void saveSurface(string fileName, FirstOrderFunction * func,
 array<double, 6> ScalePhotometric::covarianceEigenValues(const int scaleIdx,
         const Transf T12, bool baseValues)
 {
-    PhotometricPack dataPack = initPhotometricData(scaleIdx);
+    const PhotometricPack & dataPack = getPhotometricData(scaleIdx);
     PhotometricCostFunction * costFunction;
     if (baseValues)
     {
         //FIXME must be camPtr1
-        costFunction = new PhotometricCostFunction(camPtr2, _xiBaseCam, dataPack,
+        costFunction = makePhotometricCostFunction(camPtr2, _xiBaseCam, dataPack,
                                 scaleSpace1.get(), scaleSpace1.getActiveScale());
     }
     else
     {
         scaleSpace2.setActiveScale(scaleIdx);
-        costFunction = new PhotometricCostFunction(camPtr2, _xiBaseCam, dataPack,
+        costFunction = makePhotometricCostFunction(camPtr2, _xiBaseCam, dataPack,
                                 scaleSpace2.get(), scaleSpace2.getActiveScale());
     }
     cout << "Cost function is created" << endl;
@@ -257,16 +562,19 @@ array<double, 6> ScalePhotometric::covarianceEigenValues(const int scaleIdx,
     return res;    
 }
 
-void ScalePhotometric::computePoseMI(int scaleIdx, Transf & T12)
+void ScalePhotometric::computePoseMI(int scaleIdx, Transf & T12, double maxTime,
+        PoseEstimationSummary & summary)
 {
     if (verbosity > 1) 
     {
         cout << "ScalePhotometric::computePoseMI with scaleIdx = " << scaleIdx << endl;
     }
-    PhotometricPack dataPack = initPhotometricData(scaleIdx);
+    Timer timer;
+    summary.processedScales++;
+    const PhotometricPack & dataPack = getPhotometricData(scaleIdx);
     scaleSpace2.setActiveScale(scaleIdx);
     array<double, 6> pose = T12.toArray();
-    MutualInformation * costFunction = new MutualInformation(camPtr2, dataPack, _xiBaseCam,
+    MutualInformation * costFunction = makeMutualInformation(camPtr2, dataPack, _xiBaseCam,
                                 scaleSpace2.get(), scaleSpace2.getActiveScale(), 8, 255);
     
 //    if (useMotionPrior) //FIXME experimental
@@ -310,23 +618,32 @@ void ScalePhotometric::computePoseMI(int scaleIdx, Transf & T12)
     options.gradient_tolerance = 1e-3;
 //    options.linear_solver_type = ceres::DENSE_QR;
 //    options.max_num_iterations = 15;
+    if (maxTime > 0) options.max_solver_time_in_seconds = max(maxTime - timer.elapsed(), 1e-6);
     if (verbosity > 2) options.minimizer_progress_to_stdout = true;
-    GradientProblemSolver::Summary summary;
-    Solve(options, problem, pose.data(), &summary);
-    if (verbosity > 2) cout << summary.FullReport() << endl;
-    else if (verbosity > 1) cout << summary.BriefReport() << endl;
+    GradientProblemSolver::Summary solverSummary;
+    Solve(options, problem, pose.data(), &solverSummary);
+    if (verbosity > 2) cout << solverSummary.FullReport() << endl;
+    else if (verbosity > 1) cout << solverSummary.BriefReport() << endl;
     T12 = Transf(pose.data());
+    summary.iterations += solverSummary.iterations.size();
+    summary.finalCost = solverSummary.final_cost;
+    summary.dataCost = solverSummary.final_cost;
+    summary.converged = summary.converged and solverSummary.termination_type == ceres::CONVERGENCE;
+    if (maxTime > 0 and timer.elapsed() >= maxTime) summary.deadlineReached = true;
 //    cout << T12 << endl;
 //    saveSurface("surf01.txt", costFunction, 2, 3, 0.0005, 50, pose.data());
 }
 
-void ScalePhotometric::computePoseMI(int scaleIdx, Transf & T12, const Transf & Todom)
+void ScalePhotometric::computePoseMI(int scaleIdx, Transf & T12, const Transf & Todom,
+        double maxTime, PoseEstimationSummary & summary)
 {
     if (verbosity > 1) 
     {
         cout << "ScalePhotometric::computePoseMI with scaleIdx = " << scaleIdx << endl;
     }
-    PhotometricPack dataPack = initPhotometricData(scaleIdx);
+    Timer timer;
+    summary.processedScales++;
+    const PhotometricPack & dataPack = getPhotometricData(scaleIdx);
     scaleSpace2.setActiveScale(scaleIdx);
     array<double, 6> pose = T12.toArray();
     MutualInformationOdom * costFunction = new MutualInformationOdom(camPtr2, dataPack, _xiBaseCam,
@@ -374,12 +691,19 @@ void ScalePhotometric::computePoseMI(int scaleIdx, Transf & T12, const Transf &
     options.gradient_tolerance = 1e-3;
 //    options.linear_solver_type = ceres::DENSE_QR;
 //    options.max_num_iterations = 15;
+    if (maxTime > 0) options.max_solver_time_in_seconds = max(maxTime - timer.elapsed(), 1e-6);
     if (verbosity > 2) options.minimizer_progress_to_stdout = true;
-    GradientProblemSolver::Summary summary;
-    Solve(options, problem, pose.data(), &summary);
-    if (verbosity > 2) cout << summary.FullReport() << endl;
-    else if (verbosity > 1) cout << summary.BriefReport() << endl;
+    GradientProblemSolver::Summary solverSummary;
+    Solve(options, problem, pose.data(), &solverSummary);
+    if (verbosity > 2) cout << solverSummary.FullReport() << endl;
+    else if (verbosity > 1) cout << solverSummary.BriefReport() << endl;
     T12 = Transf(pose.data());
+    summary.iterations += solverSummary.iterations.size();
+    summary.finalCost = solverSummary.final_cost;
+    // the mutual information alone, at the final pose
+    costFunction->MutualInformation::Evaluate(pose.data(), &summary.dataCost, NULL);
+    summary.converged = summary.converged and solverSummary.termination_type == ceres::CONVERGENCE;
+    if (maxTime > 0 and timer.elapsed() >= maxTime) summary.deadlineReached = true;
 //    cout << T12 << endl;
 //    saveSurface("surf01.txt", costFunction, 2, 3, 0.0005, 50, pose.data());
 }
@@ -0,0 +1,137 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Levenberg-Marquardt solver for 6-DoF pose problems
+*/
+
+#include "localization/pose_solver.h"
+
+#include "std.h"
+#include "eigen.h"
+#include "ceres.h"
+#include "io.h"
+#include "timer.h"
+
+DenseNormalEquationTerm::DenseNormalEquationTerm(const ceres::CostFunction * costFunction) :
+        _costFunction(costFunction)
+{
+    assert(costFunction->parameter_block_sizes().size() == 1);
+    assert(costFunction->parameter_block_sizes()[0] == 6);
+}
+
+double DenseNormalEquationTerm::accumulateNormalEquations(const double * pose,
+        Matrix6d & JtJ, Vector6d & Jtr) const
+{
+    const int N = _costFunction->num_residuals();
+    VectorXd residual(N);
+    Matrix<double, Dynamic, 6, RowMajor> jac(N, 6);
+    double * jacPtr = jac.data();
+    _costFunction->Evaluate(&pose, residual.data(), &jacPtr);
+    JtJ += jac.transpose() * jac;
+    Jtr += jac.transpose() * residual;
+    return 0.5 * residual.squaredNorm();
+}
+
+double DenseNormalEquationTerm::computeCost(const double * pose) const
+{
+    VectorXd residual(_costFunction->num_residuals());
+    _costFunction->Evaluate(&pose, residual.data(), NULL);
+    return 0.5 * residual.squaredNorm();
+}
+
+double PoseSolver::computeCost(const double * pose) const
+{
+    double cost = 0;
+    for (auto term : _termVec)
+    {
+        cost += term->computeCost(pose);
+    }
+    return cost;
+}
+
+double PoseSolver::accumulateNormalEquations(const double * pose, Matrix6d & JtJ, Vector6d & Jtr) const
+{
+    JtJ.setZero();
+    Jtr.setZero();
+    double cost = 0;
+    for (auto term : _termVec)
+    {
+        cost += term->accumulateNormalEquations(pose, JtJ, Jtr);
+    }
+    return cost;
+}
+
+PoseSolverSummary PoseSolver::solve(double * pose) const
+{
+    Timer timer;
+    PoseSolverSummary summary;
+    Map<Vector6d> x(pose);
+    Matrix6d JtJ;
+    Vector6d Jtr;
+    double cost = accumulateNormalEquations(pose, JtJ, Jtr);
+    summary.initialCost = cost;
+    double lambda = _options.initialLambda;
+    for (summary.iterations = 0; summary.iterations < _options.maxIterations; summary.iterations++)
+    {
+        // the accepted steps only decrease the cost, so the current pose is the best one
+        if (_options.maxTime > 0 and timer.elapsed() > _options.maxTime)
+        {
+            summary.timeLimitReached = true;
+            break;
+        }
+        
+        // damped normal equations, the damping is scaled as the diagonal of JtJ
+        Matrix6d A = JtJ;
+        A.diagonal() += lambda * JtJ.diagonal().cwiseMax(1e-9);
+        const Vector6d dx = A.ldlt().solve(-Jtr);
+
+        if (dx.norm() < _options.parameterTolerance * (x.norm() + _options.parameterTolerance))
+        {
+            summary.converged = true;
+            break;
+        }
+
+        Vector6d xNew = x + dx;
+        const double costNew = computeCost(xNew.data());
+        if (_options.verbose)
+        {
+            cout << setw(5) << summary.iterations << setw(15) << costNew
+                    << setw(15) << lambda << setw(15) << dx.norm() << endl;
+        }
+        if (costNew < cost)
+        {
+            const double decrease = (cost - costNew) / cost;
+            x = xNew;
+            cost = accumulateNormalEquations(pose, JtJ, Jtr);
+            lambda = max(lambda / 10, 1e-9);
+            if (decrease < _options.functionTolerance)
+            {
+                summary.converged = true;
+                break;
+            }
+        }
+        else
+        {
+            lambda *= 10;
+            if (lambda > 1e10) break;
+        }
+    }
+    summary.finalCost = cost;
+    return summary;
+}
+
@@ -158,19 +158,17 @@ void harrisTest()
 }
 
 //FIXME TMP HARRIS FEATURES
-Vector2dVec harrisCorners(const Mat8u & img)
+// the local maxima of the Harris response
+Vector2dVec harrisCorners(const Mat32f & resp)
 {
 //    harrisTest();
-    Mat32f resp;
-    resp.create(img.size());
-    cornerHarris(img, resp, 7, 3, 0.05);
 //    harrisResp(img, resp);
     vector<pair<double, int>> respHeap;
     Vector2dVec maxVec;
     
-    for (int v = 7; v < img.rows - 7; v++)
+    for (int v = 7; v < resp.rows - 7; v++)
     {
-        for (int u = 7; u < img.cols - 7; u++)
+        for (int u = 7; u < resp.cols - 7; u++)
         {
             double respVal = resp(v, u);
             bool isMax = true;
@@ -238,6 +236,18 @@ void descriptors(const Mat8u & img, Mat32f & out, const Vector2dVec & pointVec,
 }
 
 void SparseOdometry::feedData(const Mat8u & imageNew, const Transf xiOdomNew)
+{
+    Mat32f resp;
+    FrameFeatures::computeCornerResponse(imageNew, resp);
+    feedData(imageNew, resp, xiOdomNew);
+}
+
+void SparseOdometry::feedData(const FrameFeatures & features, const Transf xiOdomNew)
+{
+    feedData(features.image(), features.cornerResponse(), xiOdomNew);
+}
+
+void SparseOdometry::feedData(const Mat8u & imageNew, const Mat32f & cornerResp, const Transf xiOdomNew)
 {
     Transf dxi = xiBaseCam.inverseCompose(xiOdom.inverseCompose(xiOdomNew)).compose(xiBaseCam);
     //FIXME for debug
@@ -245,7 +255,7 @@ void SparseOdometry::feedData(const Mat8u & imageNew, const Transf xiOdomNew)
     
     cout << "DETECT" << endl;
 //    keypointVec2 = harrisCorners(imageNew.rowRange(0, 300));
-    keypointVec2 = harrisCorners(imageNew);
+    keypointVec2 = harrisCorners(cornerResp);
     cout << "EXTRACT" << endl;
     descriptors(imageNew, desc2, keypointVec2);
     
@@ -0,0 +1,125 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Table of unit bearing vectors for every cell of a depth map grid
+*/
+
+#include "reconstruction/bearing_table.h"
+
+#include <mutex>
+#include <typeinfo>
+
+#include "std.h"
+#include "eigen.h"
+
+namespace
+{
+    // the camera model, its intrinsics and the grid define the table
+    using BearingKey = pair<string, vector<double>>;
+
+    BearingKey makeKey(const ICamera * camera, const ScaleParameters & params)
+    {
+        vector<double> valVec(camera->getParams(), camera->getParams() + camera->numParams());
+        valVec.push_back(params.scale);
+        valVec.push_back(params.u0);
+        valVec.push_back(params.v0);
+        valVec.push_back(params.xMax);
+        valVec.push_back(params.yMax);
+        return BearingKey(typeid(*camera).name(), valVec);
+    }
+
+    // the most recently requested tables are kept even if no depth map holds them,
+    // so that short-lived maps do not rebuild the table every time
+    const int MAX_RECENT_TABLES = 8;
+
+    std::mutex tableMutex;
+    map<BearingKey, std::weak_ptr<const BearingTable>> tableMap;
+    list<BearingTable::Ptr> recentList;
+
+    void markRecent(const BearingTable::Ptr & table)
+    {
+        auto iter = std::find(recentList.begin(), recentList.end(), table);
+        if (iter != recentList.end()) recentList.erase(iter);
+        recentList.push_front(table);
+        if (recentList.size() > MAX_RECENT_TABLES) recentList.pop_back();
+    }
+}
+
+BearingTable::Ptr BearingTable::get(const ICamera * camera, const ScaleParameters & params)
+{
+    const BearingKey key = makeKey(camera, params);
+    std::lock_guard<std::mutex> lock(tableMutex);
+    auto iter = tableMap.find(key);
+    if (iter != tableMap.end())
+    {
+        Ptr table = iter->second.lock();
+        if (table)
+        {
+            markRecent(table);
+            return table;
+        }
+    }
+
+    // drop the tables which are not used anymore
+    for (auto it = tableMap.begin(); it != tableMap.end(); )
+    {
+        if (it->second.expired()) it = tableMap.erase(it);
+        else ++it;
+    }
+
+    Ptr table = std::make_shared<const BearingTable>(camera, params);
+    tableMap[key] = table;
+    markRecent(table);
+    return table;
+}
+
+BearingTable::BearingTable(const ICamera * camera, const ScaleParameters & params) :
+        _params(params),
+        _xMax(params.xMax),
+        _bearingVec(params.xMax * params.yMax),
+        _maskVec(params.xMax * params.yMax, 0)
+{
+    for (int y = 0; y < params.yMax; y++)
+    {
+        for (int x = 0; x < params.xMax; x++)
+        {
+            const int idx = x + y*_xMax;
+            Vector3d & X = _bearingVec[idx];
+            if (camera->reconstructPoint(Vector2d(params.uConv(x), params.vConv(y)), X))
+            {
+                X.normalize();
+                _maskVec[idx] = 1;
+            }
+            else
+            {
+                X.setZero();
+            }
+        }
+    }
+}
+
+bool BearingTable::cellIndex(const Vector2d & pt, int & idx) const
+{
+    const int x = _params.xConv(pt[0]);
+    const int y = _params.yConv(pt[1]);
+    if (x < 0 or x >= _params.xMax or y < 0 or y >= _params.yMax) return false;
+    if (_params.uConv(x) != pt[0] or _params.vConv(y) != pt[1]) return false;
+    idx = x + y*_xMax;
+    return true;
+}
+
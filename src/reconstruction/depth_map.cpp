@@ -24,6 +24,11 @@ NOTE:
 
 #include "reconstruction/depth_map.h"
 
+#include <atomic>
+#include <cstring>
+
+#include "utils/parallel.h"
+
 #include "io.h"
 #include "std.h"
 #include "eigen.h"
@@ -91,19 +96,21 @@ void DepthMap::swapHypotheses(const int x, const int y, const int h1, const int
 
 void DepthMap::sortHypStack(const int x, const int y)
 {
-    for (int h1 = 0; h1 < hMax - 1; ++h1)
+    // the stack is accessed through the flat indices, the hypotheses are hStep apart
+    const int idx = x + y*xMax;
+    const int idxEnd = idx + hMax*hStep;
+    for (int idx1 = idx; idx1 < idxEnd - hStep; idx1 += hStep)
     {
-        for (int h2 = h1 + 1; h2 < hMax; ++h2)
+        for (int idx2 = idx1 + hStep; idx2 < idxEnd; idx2 += hStep)
         {
             //Swap if previous element is default and next element is valid hyp
-            if ( (at(x, y, h1) <= MIN_DEPTH) && (at(x, y, h2) > MIN_DEPTH) )
-            {
-                swapHypotheses(x, y, h1, h2);
-            }
-            //Swap to order in ascending order of cost
-            else if ( cost(x, y, h1) > cost(x, y, h2) )
+            //or to order in ascending order of cost
+            if ( (valVec[idx1] <= MIN_DEPTH and valVec[idx2] > MIN_DEPTH) 
+                    or costVec[idx1] > costVec[idx2] )
             {
-                swapHypotheses(x, y, h1, h2);
+                std::swap(valVec[idx1], valVec[idx2]);
+                std::swap(sigmaVec[idx1], sigmaVec[idx2]);
+                std::swap(costVec[idx1], costVec[idx2]);
             }
         }
     }
@@ -408,6 +415,32 @@ Vector2dVec DepthMap::getPointVec() const
     return result;
 }
 
+BearingTable::Ptr DepthMap::getBearingTable() const
+{
+    BearingTable::Ptr table = std::atomic_load(&bearingTable);
+    if (not table and cameraPtr != NULL)
+    {
+        // concurrent callers get the same table from the registry
+        table = BearingTable::get(cameraPtr, *this);
+        std::atomic_store(&bearingTable, table);
+    }
+    return table;
+}
+
+bool DepthMap::reconstructBearing(const BearingTable::Ptr & table, const Vector2d & pt, Vector3d & X) const
+{
+    if (cameraPtr == NULL) return false;
+    int idx;
+    if (table and table->cellIndex(pt, idx))
+    {
+        X = table->at(idx);
+        return table->isValid(idx);
+    }
+    if (not cameraPtr->reconstructPoint(pt, X)) return false;
+    X.normalize();
+    return true;
+}
+
 //TODO - Depecrated
 void DepthMap::reconstructUncertainty(vector<int> & idxVec, 
             Vector3dVec & minDistVec, Vector3dVec & maxDistVec) const
@@ -415,36 +448,19 @@ void DepthMap::reconstructUncertainty(vector<int> & idxVec,
     minDistVec.clear();
     maxDistVec.clear();
     idxVec.clear();
-    vector<double> minVec;
-    vector<double> maxVec;
-    vector<int> idxBrutVec;
+    const BearingTable::Ptr table = getBearingTable();
     for (int i = 0; i < valVec.size(); i++)
     {
         double d = valVec[i];
-        if (d >= MIN_DEPTH)
+        const int idxh = i % hStep;
+        if (d >= MIN_DEPTH and table->isValid(idxh))
         {
             double s = sigmaVec[i];
             // take d +- 2*sigma
-            minVec.push_back(max(MIN_DEPTH, d - 2*s));
-            maxVec.push_back(d + 2*s);
-            idxBrutVec.push_back(i);
-        }
-    }
-    
-    Vector2dVec pointBrutVec = getPointVec(idxBrutVec);
-    
-    Vector3dVec reconstBrutVec;
-    vector<bool> maskVec;
-    cameraPtr->reconstructPointCloud(pointBrutVec, reconstBrutVec, maskVec);
-    
-    for (int i = 0; i < reconstBrutVec.size(); i++)
-    {
-        if (maskVec[i])
-        {
-            Vector3d X = reconstBrutVec[i].normalized();
-            minDistVec.push_back(X*minVec[i]);
-            maxDistVec.push_back(X*maxVec[i]);
-            idxVec.push_back(idxBrutVec[i]);        
+            const Vector3d & X = table->at(idxh);
+            minDistVec.push_back(X*max(MIN_DEPTH, d - 2*s));
+            maxDistVec.push_back(X*(d + 2*s));
+            idxVec.push_back(i);
         }
     }
 }
@@ -454,30 +470,15 @@ void DepthMap::reconstruct(vector<int> & idxVec, Vector3dVec & result) const
 {
     result.clear();
     idxVec.clear();
-    vector<double> depthVec;
-    vector<int> idxBrutVec;
+    const BearingTable::Ptr table = getBearingTable();
     for (int i = 0; i < valVec.size(); i++)
     {
         double d = valVec[i];
-        if (d >= MIN_DEPTH)
+        const int idxh = i % hStep;
+        if (d >= MIN_DEPTH and table->isValid(idxh))
         {
-            depthVec.push_back(d);
-            idxBrutVec.push_back(i);
-        }
-    }
-    Vector2dVec pointBrutVec = getPointVec(idxBrutVec);
-    
-    Vector3dVec reconstBrutVec;
-    vector<bool> maskVec;
-    cameraPtr->reconstructPointCloud(pointBrutVec, reconstBrutVec, maskVec);
-    
-    for (int i = 0; i < reconstBrutVec.size(); i++)
-    {
-        if (maskVec[i])
-        {
-            Vector3d X = reconstBrutVec[i].normalized();
-            result.push_back(X*depthVec[i]);
-            idxVec.push_back(idxBrutVec[i]);        
+            result.push_back(table->at(idxh)*d);
+            idxVec.push_back(i);
         }
     }
 }
@@ -488,22 +489,40 @@ void DepthMap::reconstruct(const Vector2dVec & queryPointVec,
 {
     result.clear();
     idxVec.clear();
-    Vector3dVec reconstBrutVec;
-    vector<bool> maskVec;
-    cameraPtr->reconstructPointCloud(queryPointVec, reconstBrutVec, maskVec);
+    const BearingTable::Ptr table = getBearingTable();
     for (int i = 0; i < queryPointVec.size(); i++)
     {
-        if (maskVec[i])
-        {
-            double d = nearest(queryPointVec[i]);
-            if (d < MIN_DEPTH) continue;
-            Vector3d X = reconstBrutVec[i].normalized();
-            result.push_back(X*d);
-            idxVec.push_back(i);        
-        }
+        double d = nearest(queryPointVec[i]);
+        if (d < MIN_DEPTH) continue;
+        Vector3d X;
+        if (not reconstructBearing(table, queryPointVec[i], X)) continue;
+        result.push_back(X*d);
+        idxVec.push_back(i);
+    }
+}
+
+
+DepthMap::DepthMap(const ICamera * camera, const SparseDepthMap & sparse, const int hMax) :
+        DepthMap(camera, (const ScaleParameters &)sparse, hMax)
+{
+    for (int i = 0; i < sparse.size(); i++)
+    {
+        const int idx = sparse.index(i);
+        valVec[idx] = sparse.depth(i);
+        sigmaVec[idx] = sparse.sigma(i);
     }
 }
 
+void DepthMap::toSparse(SparseDepthMap & sparse) const
+{
+    (ScaleParameters &)sparse = *this;
+    sparse.clear();
+    for (int idx = 0; idx < hStep; idx++)
+    {
+        if (valVec[idx] < MIN_DEPTH) continue;
+        sparse.push_back(idx, valVec[idx], sigmaVec[idx]);
+    }
+}
 
 vector<int> DepthMap::getIdxVec(const Vector2dVec & queryPointVec) const
 {
@@ -529,46 +548,84 @@ vector<int> DepthMap::getIdxVec(const Vector2dVec & queryPointVec) const
 }
 
 
+// resizes the field if it is requested, empties it otherwise
+// the allocated memory is kept in both cases
+template<typename T>
+void prepareField(std::vector<T> & field, const bool isRequested, const int size)
+{
+    if (isRequested) field.resize(size);
+    else field.clear();
+}
+
 void DepthMap::reconstruct(MHPack & result, const uint32_t reconstFlags) const
 {
     assert(not (reconstFlags & IMAGE_VALUES)); //FIXME imageValues are not implemented
     const int numHyps = (reconstFlags & ALL_HYPOTHESES) ? hMax : 1;
-
-    // Convert query points to query indices
-    vector<int> queryIdxVec;
-    Vector2dVec queryPointVec;
-    if (reconstFlags & QUERY_INDICES)
-    {
-        swap(queryIdxVec, result.idxVec);
-        queryPointVec = getPointVec(queryIdxVec);
-    }
-    else if (reconstFlags & QUERY_POINTS)
+    const bool queryIndices = reconstFlags & QUERY_INDICES;
+    const bool queryPoints = not queryIndices and (reconstFlags & QUERY_POINTS);
+    const int cloudStep = (reconstFlags & MINMAX) ? 2 : 1;
+
+    // Move the query to the scratch buffers of the pack, 
+    // so that the output can be written without extra allocations
+    int numQueries = hStep;
+    if (queryIndices)
     {
-        queryIdxVec = getIdxVec(result.imagePointVec);
-        swap(queryPointVec, result.imagePointVec);
+        swap(result.queryIdxVec, result.idxVec);
+        numQueries = result.queryIdxVec.size();
     }
-    else
+    else if (queryPoints)
     {
-        queryIdxVec = getIdxVec();
-        queryPointVec = getPointVec(queryIdxVec);
+        swap(result.queryPointVec, result.imagePointVec);
+        numQueries = result.queryPointVec.size();
     }
 
-    result.idxVec.clear();
-    result.idxMapVec.clear();
-    result.hypIdxVec.clear();
-    result.costVec.clear();
-    result.sigmaVec.clear();
-    result.cloud.clear();
+    // The upper bound on the size, the fields are cut to the exact size in the end
+    const int maxSize = numQueries * numHyps;
+    prepareField(result.idxVec, true, maxSize);
+    prepareField(result.cloud, true, maxSize * cloudStep);
+    prepareField(result.idxMapVec, reconstFlags & INDEX_MAPPING, maxSize);
+    prepareField(result.imagePointVec, reconstFlags & IMAGE_POINTS, maxSize);
+    prepareField(result.hypIdxVec, reconstFlags & HYPOTHESIS_INDICES, maxSize);
+    prepareField(result.sigmaVec, reconstFlags & SIGMA_VALUE, maxSize);
+    prepareField(result.costVec, reconstFlags & COST_VALUE, maxSize);
     result.valVec.clear();
 //result.datatype = (minmax_flag) ? MHPack::MINMAX_DISTANCE_VEC_WITH_SIGN : MHPack::RECONSTRUCTION_WITH_SIGMA;
 
-    vector<double> depthVec;
-    for (int i = 0; i < queryIdxVec.size(); i++)
+    const BearingTable::Ptr table = getBearingTable();
+    int count = 0;
+    int mapIdx = -1;
+    for (int i = 0; i < numQueries; i++)
     {
-        if (queryIdxVec[i] < 0 or queryIdxVec[i] > hStep) continue;
+        // find the depth map cell
+        int queryIdx;
+        if (queryIndices)
+        {
+            queryIdx = result.queryIdxVec[i];
+            if (queryIdx < 0 or queryIdx >= hStep) continue;
+            mapIdx = i;
+        }
+        else if (queryPoints)
+        {
+            const Vector2d & pt = result.queryPointVec[i];
+            const int x = xConv(pt[0]);
+            const int y = yConv(pt[1]);
+            if (not isValid(x, y)) continue;
+            queryIdx = x + y*xMax;
+            mapIdx = i;
+        }
+        else
+        {
+            // the index among the cells with a valid first hypothesis
+            if (valVec[i] < MIN_DEPTH) continue;
+            queryIdx = i;
+            mapIdx++;
+        }
+
+        // the bearing is computed once for all the hypotheses of the cell
+        Vector3d X;
+        bool bearingComputed = false;
         for (int h = 0; h < numHyps; h++)
         {
-            const int queryIdx = queryIdxVec[i];
             double depth = valVec[queryIdx + h*hStep];
             double sigma = sigmaVec[queryIdx + h*hStep]; //TODO discard points with sigma > sigmaMax
             if (depth < MIN_DEPTH or depth == OUT_OF_RANGE)
@@ -580,58 +637,55 @@ void DepthMap::reconstruct(MHPack & result, const uint32_t reconstFlags) const
                 }
                 else continue;
             }
-            
-            if (reconstFlags & MINMAX) 
-            {
-                depthVec.push_back(max(depth - 3*sigma, MIN_DEPTH));
-                depthVec.push_back(depth + 3*sigma);
-            }
-            else
+
+            if (not bearingComputed)
             {
-                depthVec.push_back(depth);
+                bool isReconstructed;
+                if (queryPoints)
+                {
+                    isReconstructed = reconstructBearing(table, result.queryPointVec[i], X);
+                }
+                else
+                {
+                    X = table->at(queryIdx);
+                    isReconstructed = table->isValid(queryIdx);
+                }
+                if (not isReconstructed) break;
+                bearingComputed = true;
             }
             
-            if (reconstFlags & SIGMA_VALUE) result.sigmaVec.push_back(sigma);
-            result.idxVec.push_back(queryIdx);
-            result.hypIdxVec.push_back(h);
-            result.imagePointVec.push_back(queryPointVec[i]);
-            if (reconstFlags & INDEX_MAPPING) result.idxMapVec.push_back(i);
-        }
-    }
-
-    vector<bool> maskVec;
-    Vector3dVec cloud;
-    cameraPtr->reconstructPointCloud( result.imagePointVec, cloud, maskVec );
-    result.cloud.reserve((reconstFlags & MINMAX) ? 2 * cloud.size() : cloud.size());
-    for (int i = 0; i < cloud.size(); i++)
-    {
-        if (maskVec[i])
-        {
-            if (reconstFlags & MINMAX)
+            if (reconstFlags & MINMAX) 
             {
-                result.cloud.push_back(cloud[i].normalized() * depthVec[2*i]);
-                result.cloud.push_back(cloud[i].normalized() * depthVec[2*i + 1]);
+                result.cloud[2*count] = X * max(depth - 3*sigma, MIN_DEPTH);
+                result.cloud[2*count + 1] = X * (depth + 3*sigma);
             }
             else
             {
-                result.cloud.push_back(cloud[i].normalized() * depthVec[i]);
-            }
-        }
-        else
-        {
-            //FIXME make all data in MHPack valid
-            //that is discard all non-reconstructed points and other data associated to them
-            if (reconstFlags & MINMAX)
-            {
-                result.cloud.emplace_back(0, 0, 0);
-                result.cloud.emplace_back(0, 0, 0);
+                result.cloud[count] = X * depth;
             }
-            else
+            
+            result.idxVec[count] = queryIdx;
+            if (reconstFlags & INDEX_MAPPING) result.idxMapVec[count] = mapIdx;
+            if (reconstFlags & HYPOTHESIS_INDICES) result.hypIdxVec[count] = h;
+            if (reconstFlags & SIGMA_VALUE) result.sigmaVec[count] = sigma;
+            if (reconstFlags & COST_VALUE) result.costVec[count] = costVec[queryIdx + h*hStep];
+            if (reconstFlags & IMAGE_POINTS)
             {
-                result.cloud.emplace_back(0, 0, 0);
+                if (queryPoints) result.imagePointVec[count] = result.queryPointVec[i];
+                else result.imagePointVec[count] = Vector2d(uConv(queryIdx % xMax), vConv(queryIdx / xMax));
             }
+            count++;
         }
     }
+
+    // shrinking does not release the memory
+    result.idxVec.resize(count);
+    result.cloud.resize(count * cloudStep);
+    if (reconstFlags & INDEX_MAPPING) result.idxMapVec.resize(count);
+    if (reconstFlags & IMAGE_POINTS) result.imagePointVec.resize(count);
+    if (reconstFlags & HYPOTHESIS_INDICES) result.hypIdxVec.resize(count);
+    if (reconstFlags & SIGMA_VALUE) result.sigmaVec.resize(count);
+    if (reconstFlags & COST_VALUE) result.costVec.resize(count);
 }
 
 
@@ -723,38 +777,74 @@ void DepthMap::wrapDepth(const DepthMap& dMap1, const DepthMap& dMap2,
 DepthMap DepthMap::wrapDepth(const Transformation<double> T12) const
 {
     DepthMap dMap2(cameraPtr, *this);
-
-    // Get point-cloud of current frame
-    MHPack cloud11MH;
-    reconstruct(cloud11MH, 0);
-
-    // Transform cloud into keyframe
-    Vector3dVec cloud12;
-    T12.inverseTransform(cloud11MH.cloud, cloud12);
-
-    // Project point cloud on keyframe
-    Vector2dVec point12Vec;
-    cameraPtr->projectPointCloud(cloud12, point12Vec);
-
-    // Fill in data for depthmap
-    vector<int> idx12Vec = getIdxVec(point12Vec);
-    for (int i = 0; i < idx12Vec.size(); i++)
+    const BearingTable::Ptr table = getBearingTable();
+    const Vector3d t12 = T12.trans();
+
+    // z-buffer, the depth as float in the high word and the source index in the low one
+    // positive floats are ordered as their bit patterns, so the minimal key is 
+    // the closest point, and among equal depths the one with the smallest index
+    const uint64_t EMPTY_KEY = std::numeric_limits<uint64_t>::max();
+    vector<std::atomic<uint64_t>> zBuffer(hStep);
+    for (auto & key : zBuffer) key.store(EMPTY_KEY, std::memory_order_relaxed);
+
+    // forward splatting, the rows of the source map are projected in batches
+    parallelFor(0, yMax, FILTER_BAND_HEIGHT, [&](const int yBegin, const int yEnd)
     {
-        const int idx2 = idx12Vec[i];
-        const int idx1 = cloud11MH.idxVec[i];
-        if(idx2 != -1) //TODO figure out why not equivalent to isValid(...)
+        ArrayX3d cloud12;
+        ArrayX2d point12Arr;
+        vector<uint8_t> maskVec;
+        vector<int> srcIdxVec;
+        srcIdxVec.reserve(xMax);
+        for (int y = yBegin; y < yEnd; y++)
         {
-            const double depthNew = cloud12[i].norm();
-            double & depthOld = dMap2.at(idx2);
-            if (depthOld == OUT_OF_RANGE or depthNew < depthOld)
+            srcIdxVec.clear();
+            for (int idx1 = y * xMax; idx1 < (y + 1) * xMax; idx1++)
+            {
+                if (valVec[idx1] < MIN_DEPTH or not table->isValid(idx1)) continue;
+                srcIdxVec.push_back(idx1);
+            }
+            const int n = srcIdxVec.size();
+            cloud12.resize(n, 3);
+            for (int i = 0; i < n; i++)
             {
-                const double dist = cloud12[i].norm();
-                dMap2.at(idx2) = dist;
-                dMap2.sigma(idx2) = sigma(idx1) + 0.005*dist;
-                dMap2.cost(idx2) = cost(idx1);
+                const int idx1 = srcIdxVec[i];
+                cloud12.row(i) = (table->at(idx1) * valVec[idx1]).transpose().array();
+            }
+            T12.inverseTransform(cloud12, cloud12);
+            cameraPtr->projectPointArray(cloud12, point12Arr, maskVec);
+            for (int i = 0; i < n; i++)
+            {
+                if (not maskVec[i]) continue;
+                const int x2 = xConv(point12Arr(i, 0));
+                const int y2 = yConv(point12Arr(i, 1));
+                if (not isValid(x2, y2)) continue;
+                const float depthNew = cloud12.row(i).matrix().norm();
+                uint32_t depthBits;
+                std::memcpy(&depthBits, &depthNew, sizeof(depthBits));
+                const uint64_t key = (uint64_t(depthBits) << 32) | uint32_t(srcIdxVec[i]);
+                std::atomic<uint64_t> & cell = zBuffer[x2 + y2 * xMax];
+                uint64_t oldKey = cell.load(std::memory_order_relaxed);
+                while (key < oldKey and not cell.compare_exchange_weak(oldKey, key, 
+                        std::memory_order_relaxed));
             }
         }
-    }
+    });
+
+    // resolve the z-buffer, the distance is recomputed in double precision
+    // the rotation does not change the norm, so |R12^-1 * (X1 - t12)| = |X1 - t12|
+    parallelFor(0, yMax, FILTER_BAND_HEIGHT, [&](const int yBegin, const int yEnd)
+    {
+        for (int idx2 = yBegin * xMax; idx2 < yEnd * xMax; idx2++)
+        {
+            const uint64_t key = zBuffer[idx2].load(std::memory_order_relaxed);
+            if (key == EMPTY_KEY) continue;
+            const int idx1 = key & 0xffffffff;
+            const double dist = (table->at(idx1) * valVec[idx1] - t12).norm();
+            dMap2.at(idx2) = dist;
+            dMap2.sigma(idx2) = sigma(idx1) + 0.005*dist;
+            dMap2.cost(idx2) = cost(idx1);
+        }
+    });
 
     return dMap2;
 }
@@ -868,49 +958,90 @@ void DepthMap::pixelAverageFilter(const Vector3iVec & matches, DepthMap & dst)
 void DepthMap::filterNoise()
 {
     const int minMatches = 2;
-
-    // Create copy of current depthmap, to avoid flow
-    DepthMap myCopy = *this;
-
-    const array<int, 8> dxArr =  {-1,  0,  1,  1,  1,  0, -1, -1};
-    const array<int, 8> dyArr  = { 1,  1,  1,  0, -1, -1, -1,  0};
-    
     const int CENTRAL_WEIGHT = 5;
-    // Three loops to loop through every hypothesis
-    for (int y = 1; y < yMax - 1; ++y)
+    
+    // the first hypothesis layer is filtered into the buffers, every cell is written once,
+    // then a single-hypothesis map swaps them with its layer (ping-pong),
+    // so the old layer becomes the buffer of the next call
+    filterDepthBuf.resize(hStep);
+    filterSigmaBuf.resize(hStep);
+    double * depthDst = filterDepthBuf.data();
+    double * sigmaDst = filterSigmaBuf.data();
+    const double * depthSrc = valVec.data();
+    const double * sigmaSrc = sigmaVec.data();
+    
+    // the border rows are not filtered
+    if (yMax > 0)
+    {
+        const int lastRow = (yMax - 1) * xMax;
+        copy(depthSrc, depthSrc + xMax, depthDst);
+        copy(sigmaSrc, sigmaSrc + xMax, sigmaDst);
+        copy(depthSrc + lastRow, depthSrc + lastRow + xMax, depthDst + lastRow);
+        copy(sigmaSrc + lastRow, sigmaSrc + lastRow + xMax, sigmaDst + lastRow);
+    }
+    
+    // neighbour offsets in the flat array
+    const array<int, 8> offsetArr = {xMax - 1, xMax, xMax + 1, 1, 
+                                    -xMax + 1, -xMax, -xMax - 1, -1};
+    
+    // the map is cut into bands of rows processed in parallel
+    // the source layer is read-only, each band writes only its own rows
+    parallelFor(1, yMax - 1, FILTER_BAND_HEIGHT, [&](const int yBegin, const int yEnd)
     {
-        for (int x = 1; x < xMax - 1; ++x)
+        for (int y = yBegin; y < yEnd; ++y)
         {
-            double depthVal = myCopy.at(x, y);
-            if (depthVal == OUT_OF_RANGE) continue;
-            double sigmaVal = myCopy.sigma(x, y);
-            int countFilled = 0, countMatches = 0;
-            double acc = depthVal * CENTRAL_WEIGHT;
-            for (int i = 0; i < 8; i++)
-            {
-                int x2 = x + dxArr[i];
-                int y2 = y + dyArr[i];
-                double neighDepthVal = myCopy.at(x2, y2);
-//                double neighSigmaVal = myCopy.sigma(x + dxArr[i], y + dyArr[i]);
-                if (neighDepthVal == OUT_OF_RANGE) continue;
-                countFilled++;
-                double err = abs(depthVal - neighDepthVal);
-                if (err > sigmaVal or err > 3*myCopy.sigma(x2, y2)) continue;
-                countMatches++;
-                acc += neighDepthVal;
-            }
-            if (countMatches < minMatches and countMatches < countFilled or countFilled < 2)
-            {
-                at(x, y) = OUT_OF_RANGE;
-                sigma(x, y) = OUT_OF_RANGE;
-            }
-            else
+            // neither are the border columns
+            const int rowBegin = y * xMax, rowLast = rowBegin + xMax - 1;
+            depthDst[rowBegin] = depthSrc[rowBegin];
+            sigmaDst[rowBegin] = sigmaSrc[rowBegin];
+            depthDst[rowLast] = depthSrc[rowLast];
+            sigmaDst[rowLast] = sigmaSrc[rowLast];
+            for (int x = 1; x < xMax - 1; ++x)
             {
-                at(x, y) = acc / (countMatches + CENTRAL_WEIGHT);
+                const int idx = x + y * xMax;
+                const double depthVal = depthSrc[idx];
+                const double sigmaVal = sigmaSrc[idx];
+                depthDst[idx] = depthVal;
+                sigmaDst[idx] = sigmaVal;
+                if (depthVal == OUT_OF_RANGE) continue;
+                int countFilled = 0, countMatches = 0;
+                double acc = depthVal * CENTRAL_WEIGHT;
+                // no branches in the neighbourhood loop, the tests are accumulated as integers
+                for (int i = 0; i < 8; i++)
+                {
+                    const double neighDepthVal = depthSrc[idx + offsetArr[i]];
+                    const double err = abs(depthVal - neighDepthVal);
+                    const int isFilled = (neighDepthVal != OUT_OF_RANGE);
+                    const int isMatch = isFilled & (err <= sigmaVal) 
+                            & (err <= 3 * sigmaSrc[idx + offsetArr[i]]);
+                    countFilled += isFilled;
+                    countMatches += isMatch;
+                    acc += isMatch * neighDepthVal;
+                }
+                if (countMatches < minMatches and countMatches < countFilled or countFilled < 2)
+                {
+                    depthDst[idx] = OUT_OF_RANGE;
+                    sigmaDst[idx] = OUT_OF_RANGE;
+                }
+                else
+                {
+                    depthDst[idx] = acc / (countMatches + CENTRAL_WEIGHT);
+                }
             }
         }
+    });
+    
+    if (hMax == 1)
+    {
+        swap(valVec, filterDepthBuf);
+        swap(sigmaVec, filterSigmaBuf);
+    }
+    else
+    {
+        // the other layers stay in place, only the first one is written back
+        copy(filterDepthBuf.begin(), filterDepthBuf.end(), valVec.begin());
+        copy(filterSigmaBuf.begin(), filterSigmaBuf.end(), sigmaVec.begin());
     }
-
 }
 
 //TODO remove multihyp thing
@@ -959,25 +1090,27 @@ void DepthMap::merge(const DepthMap & depth2)
 
 void DepthMap::regularize()
 {
-    const int minMatches = 2;
-    // Three loops to loop through every hypothesis
-    for (int h = 0; h < hMax - 1; ++h)
+    // the valid hypotheses of each cell are moved to the front of its stack,
+    // their order is kept; the cells are independent so the rows are processed in parallel
+    parallelFor(0, yMax, FILTER_BAND_HEIGHT, [&](const int yBegin, const int yEnd)
     {
-        for (int y = 0; y < yMax; ++y)
+        for (int idx = yBegin * xMax; idx < yEnd * xMax; ++idx)
         {
-            for (int x = 0; x < xMax; ++x)
+            int h = 0;
+            for (int h2 = 0; h2 < hMax; ++h2)
             {
-                if (at(x, y, h) < MIN_DEPTH)
+                const int idx2 = idx + h2 * hStep;
+                if (valVec[idx2] < MIN_DEPTH) continue;
+                if (h2 != h)
                 {
-                    int h2 = h + 1;
-                    while (h2 < hMax and at(x, y, h2) < MIN_DEPTH) h2++;
-                    if (h2 == hMax) continue;
-                    at(x, y, h) = at(x, y, h2);
-                    sigma(x, y, h) = sigma(x, y, h2);
-                    cost(x, y, h) = cost(x, y, h2);
-                    at(x, y, h2) = OUT_OF_RANGE;
-                }             
+                    const int idx1 = idx + h * hStep;
+                    valVec[idx1] = valVec[idx2];
+                    sigmaVec[idx1] = sigmaVec[idx2];
+                    costVec[idx1] = costVec[idx2];
+                    valVec[idx2] = OUT_OF_RANGE;
+                }
+                h++;
             }
         }
-    }
+    });
 }
@@ -113,6 +113,73 @@ void EnhancedSgm::computeUVCache()
     }
 }
 
+void EnhancedSgm::getEpipolarPoints(const int x, const int y, const int disparity, const int step,
+        int & u21, int & v21, int & u22, int & v22) const
+{
+    // the cache covers DISPARITY_MARGIN on each side of [0, dispMax),
+    // the points beyond it (large steps) are rasterized
+    if (_params.useUVCache and disparity >= -DISPARITY_MARGIN
+            and disparity + step < _params.dispMax + DISPARITY_MARGIN)
+    {
+        const int u_vCacheStep = _params.dispMax + 2 * DISPARITY_MARGIN;
+        u21 = _uCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity);
+        u22 = _uCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity + step);
+        v21 = _vCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity);
+        v22 = _vCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity + step);
+    }
+    else
+    {       
+        CurveRasterizer<int, Polynomial2> raster = getCurveRasteriser(CAMERA_2, getLinearIndex(x, y));
+        raster.steps(disparity);
+        u21 = raster.u;
+        v21 = raster.v;
+        raster.steps(step);
+        u22 = raster.u;
+        v22 = raster.v;
+    }
+}
+
+void EnhancedSgm::computeDepthCache()
+{
+    if (_params.verbosity > 1) cout << "EnhancedSgm::computeDepthCache" << endl;
+    const int numSteps = _params.scaleVec.size();
+    const int dispStep = _params.dispMax + 1;
+    _stepIdxVec.assign(*max_element(_params.scaleVec.begin(), _params.scaleVec.end()) + 1, -1);
+    for (int i = 0; i < numSteps; i++)
+    {
+        _stepIdxVec[_params.scaleVec[i]] = i;
+    }
+    
+    // the values of a fresh DepthMap are kept where the triangulation fails
+    _depthCache.create(_params.yMax, _params.xMax * numSteps * dispStep);
+    _sigmaCache.create(_params.yMax, _params.xMax * numSteps * dispStep);
+    _depthCache.setTo(OUT_OF_RANGE);
+    _sigmaCache.setTo(DEFAULT_SIGMA_DEPTH);
+    for (int y = 0; y < _params.yMax; y++)
+    {
+        for (int x = 0; x < _params.xMax; x++)
+        {
+            int idx = getLinearIndex(x, y);
+            if (not _maskVec[idx]) continue;
+            const auto & pt1 = _pointVec1[idx];
+            for (int s = 0; s < numSteps; s++)
+            {
+                float * depthPtr = (float *)_depthCache.row(y).data + (x*numSteps + s)*dispStep;
+                float * sigmaPtr = (float *)_sigmaCache.row(y).data + (x*numSteps + s)*dispStep;
+                for (int disparity = -1; disparity < _params.dispMax; disparity++)
+                {
+                    int u21, v21, u22, v22;
+                    getEpipolarPoints(x, y, disparity, _params.scaleVec[s], u21, v21, u22, v22);
+                    double d = OUT_OF_RANGE, sigma = DEFAULT_SIGMA_DEPTH;
+                    triangulate(pt1[0], pt1[1], u21, v21, u22, v22, d, sigma);
+                    depthPtr[disparity + 1] = d;
+                    sigmaPtr[disparity + 1] = sigma;
+                }
+            }
+        }
+    }
+}
+
 void EnhancedSgm::createBuffer()
 {
     if (_params.verbosity > 1) cout << "EnhancedSgm::createBuffer" << endl;
@@ -183,35 +250,31 @@ void EnhancedSgm::reconstructDepth(DepthMap & depth) const
                 }
                 int disparity = _smallDisparity(y, x*_params.hypMax + h);
                 
+                int step = _stepBuffer(y, x);
+                
+                // gather the precomputed triangulation
+                if (_params.useDepthCache and disparity >= -1 and disparity < _params.dispMax
+                    and step >= 0 and step < int(_stepIdxVec.size()) and _stepIdxVec[step] != -1)
+                {
+                    const int cacheIdx = (x*_params.scaleVec.size() + _stepIdxVec[step])
+                            * (_params.dispMax + 1) + disparity + 1;
+                    depth.at(x, y, h) = _depthCache(y, cacheIdx);
+                    depth.sigma(x, y, h) = _sigmaCache(y, cacheIdx);
+                    continue;
+                }
+                
                 // point on the first image
                 const auto & pt1 = _pointVec1[idx];
                 
                 // to compute point on the second image
-                // TODO make virtual rasterizer using the cache
                 int u21, v21, u22, v22;
-                int step = _stepBuffer(y, x);
-                if (_params.useUVCache)
-                {
-                    const int u_vCacheStep = _params.dispMax + 2 * DISPARITY_MARGIN;
-                    u21 = _uCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity);
-                    u22 = _uCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity + step);
-                    v21 = _vCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity);
-                    v22 = _vCache(y, x*u_vCacheStep + DISPARITY_MARGIN + disparity + step);
-                }
-                else
-                {       
-                    CurveRasterizer<int, Polynomial2> raster = getCurveRasteriser(CAMERA_2, idx);
-                    raster.steps(disparity);
-                    u21 = raster.u;
-                    v21 = raster.v;
-                    raster.steps(step);
-                    u22 = raster.u;
-                    v22 = raster.v;
-                }
+                getEpipolarPoints(x, y, disparity, step, u21, v21, u22, v22);
                 
-                triangulate(pt1[0], pt1[1], u21, v21, u22, v22,
-                             depth.at(x, y, h), depth.sigma(x, y, h));
-                        
+                // the same values as in the cache where the triangulation fails
+                double d = OUT_OF_RANGE, sigma = DEFAULT_SIGMA_DEPTH;
+                triangulate(pt1[0], pt1[1], u21, v21, u22, v22, d, sigma);
+                depth.at(x, y, h) = d;
+                depth.sigma(x, y, h) = sigma;
             }
         }
     }
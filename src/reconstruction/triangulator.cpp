@@ -243,3 +243,198 @@ void Triangulator::computeRegular(const Vector3d p, Vector3d q,
     }
 }
 
+namespace
+{
+    // the 6 columns of the jacobian, as a row-major view on the output
+    using JacobianArray = Map<Eigen::Array<double, Dynamic, 6, RowMajor>>;
+    
+    // cross product a x b in structure-of-arrays form
+    void crossArr(const ArrayX3d & a, const ArrayX3d & b, ArrayX3d & c)
+    {
+        c.resize(a.rows(), 3);
+        c.col(0) = a.col(1) * b.col(2) - a.col(2) * b.col(1);
+        c.col(1) = a.col(2) * b.col(0) - a.col(0) * b.col(2);
+        c.col(2) = a.col(0) * b.col(1) - a.col(1) * b.col(0);
+    }
+    
+    // dot products with a constant vector
+    ArrayXd dotArr(const ArrayX3d & a, const Vector3d & b)
+    {
+        return a.col(0) * b[0] + a.col(1) * b[1] + a.col(2) * b[2];
+    }
+    
+    ArrayXd dotArr(const ArrayX3d & a, const ArrayX3d & b)
+    {
+        return a.col(0) * b.col(0) + a.col(1) * b.col(1) + a.col(2) * b.col(2);
+    }
+    
+    // each point of b times the corresponding coefficient in k
+    ArrayX3d scaleArr(const ArrayXd & k, const ArrayX3d & b)
+    {
+        return b.colwise() * k;
+    }
+    
+    ArrayX3d constArr(const int n, const Vector3d & v)
+    {
+        return ArrayX3d::Ones(n, 3).rowwise() * v.transpose().array();
+    }
+    
+    // jac = a * jacDeltaI + b * jacDelta for both V and Omega
+    void writeJacobian(double * jac, const ArrayXd & a, const ArrayXd & b,
+            const ArrayX3d & jacDeltaIV, const ArrayX3d & jacDeltaIOmega,
+            const ArrayX3d & jacDeltaV, const ArrayX3d & jacDeltaOmega)
+    {
+        JacobianArray jacArr(jac, a.size(), 6);
+        for (int j = 0; j < 3; j++)
+        {
+            jacArr.col(j) = a * jacDeltaIV.col(j) + b * jacDeltaV.col(j);
+            jacArr.col(j + 3) = a * jacDeltaIOmega.col(j) + b * jacDeltaOmega.col(j);
+        }
+    }
+}
+
+void Triangulator::compute(const ArrayX3d & pArr, const ArrayX3d & qArr0,
+        double * res1, double * res2,
+        double * jac1, double * jac2) const
+{
+    assert(pArr.rows() == qArr0.rows());
+    assert(res1 != NULL or res2 != NULL);
+    if (jac1 != NULL)
+    {
+        assert(res1 != NULL);
+    }
+    if (jac2 != NULL)
+    {
+        assert(res2 != NULL);
+    }
+    const int n = pArr.rows();
+    if (n == 0) return;
+    const ArrayX3d qArr = (qArr0.matrix() * R.transpose()).array();
+    const ArrayXd pq = dotArr(pArr, qArr);
+    const ArrayXd pp = dotArr(pArr, pArr);
+    const ArrayXd qq = dotArr(qArr, qArr);
+    const ArrayXd tp = dotArr(pArr, t);
+    const ArrayXd tq = dotArr(qArr, t);
+    const ArrayXd ppqq = pp * qq;
+    const ArrayXd delta = -pp * qq + pq * pq;
+    
+    // the degenerate points get zero results and jacobians
+    const ArrayXd deltaInv = (delta.abs() < ppqq * 1e-6).select(0., 1. / delta);
+    ArrayXd lambda1, lambda2;
+    if (res1 != NULL)
+    {
+        lambda1 = (-tp * qq + tq * pq) * deltaInv;
+        Map<ArrayXd>(res1, n) = lambda1;
+    }
+    if (res2 != NULL)
+    {
+        lambda2 = (pp * tq - pq * tp) * deltaInv;
+        Map<ArrayXd>(res2, n) = lambda2;
+    }
+    
+    if (jac1 != NULL or jac2 != NULL)
+    {
+        const ArrayX3d tArr = constArr(n, t);
+        ArrayX3d qp, jacDeltaOmega;
+        crossArr(qArr, pArr, qp);
+        jacDeltaOmega = scaleArr(2 * pq, qp);
+        ArrayX3d jacDeltaIOmega;
+        if (jac1 != NULL)
+        {
+            const ArrayX3d jacDelta1V = scaleArr(pq, qArr) - scaleArr(qq, pArr);
+            crossArr(qArr, scaleArr(pq, tArr) + scaleArr(tq, pArr), jacDeltaIOmega);
+            // jacV = deltaInv * jacDelta1V, jacOmega = deltaInv * (jacDelta1Omega - res1 * jacDeltaOmega)
+            writeJacobian(jac1, deltaInv, -deltaInv * lambda1,
+                    jacDelta1V, jacDeltaIOmega, ArrayX3d::Zero(n, 3), jacDeltaOmega);
+        }
+        if (jac2 != NULL)
+        {
+            const ArrayX3d jacDelta2V = scaleArr(pp, qArr) - scaleArr(pq, pArr);
+            crossArr(qArr, scaleArr(pp, tArr) - scaleArr(tp, pArr), jacDeltaIOmega);
+            writeJacobian(jac2, deltaInv, -deltaInv * lambda2,
+                    jacDelta2V, jacDeltaIOmega, ArrayX3d::Zero(n, 3), jacDeltaOmega);
+        }
+    }
+}
+
+void Triangulator::computeRegular(const ArrayX3d & pArr, const ArrayX3d & qArr0,
+        double * res1, double * res2,
+        double * jac1, double * jac2) const
+{
+    assert(pArr.rows() == qArr0.rows());
+    assert(res1 != NULL or res2 != NULL);
+    if (jac1 != NULL)
+    {
+        assert(res1 != NULL);
+    }
+    if (jac2 != NULL)
+    {
+        assert(res2 != NULL);
+    }
+    const int n = pArr.rows();
+    if (n == 0) return;
+    const ArrayX3d qArr = (qArr0.matrix() * R.transpose()).array();
+    const ArrayX3d rArr = pArr + qArr;
+    const ArrayXd pq = dotArr(pArr, qArr);
+    const ArrayXd tp = dotArr(pArr, t);
+    const ArrayXd tq = dotArr(qArr, t);
+    const ArrayXd tr = dotArr(rArr, t);
+    const double tt = t.dot(t);
+    const ArrayXd rp = dotArr(rArr, pArr);
+    const ArrayXd rq = dotArr(rArr, qArr);
+    const ArrayXd delta = tp*rq - tq*rp;
+    const double eps2Inv = 1. / (eps * eps);
+    
+    // regDiv without branches, both sides are computed and the valid one is selected
+    ArrayXd delta1, delta2, lambda1, lambda2;
+    if (res1 != NULL)
+    {
+        delta1 = tt * rq - tr * tq;
+        lambda1 = (delta > eps * delta1).select(delta1 / delta,
+                (delta1 == 0).select(2. / eps, 2. / eps - delta * eps2Inv / delta1));
+        Map<ArrayXd>(res1, n) = lambda1;
+    }
+    if (res2 != NULL)
+    {
+        delta2 = tt * rp - tr * tp;
+        lambda2 = (delta > eps * delta2).select(delta2 / delta,
+                (delta2 == 0).select(2. / eps, 2. / eps - delta * eps2Inv / delta2));
+        Map<ArrayXd>(res2, n) = lambda2;
+    }
+    
+    if (jac1 != NULL or jac2 != NULL)
+    {
+        const ArrayXd deltaInv = 1. / delta;
+        const ArrayX3d tArr = constArr(n, t);
+        const ArrayX3d jacDeltaV = scaleArr(rq, pArr) - scaleArr(rp, qArr);
+        ArrayX3d jacDeltaOmega, jacDeltaIOmega;
+        crossArr(qArr, scaleArr(tp - tq, pArr) - scaleArr(rp, tArr), jacDeltaOmega);
+        if (jac1 != NULL)
+        {
+            const ArrayX3d jacDelta1V = scaleArr(2 * rq, tArr) - scaleArr(tq, rArr) - scaleArr(tr, qArr);
+            crossArr(qArr, tt * pArr - scaleArr(tq + tr, tArr), jacDeltaIOmega);
+            // regular case : a = 1 / delta, b = -res1 / delta
+            // extrapolated case : a = delta / (eps^2 delta1^2), b = -1 / (eps^2 delta1)
+            const ArrayXd deltaInv1 = 1. / delta1;
+            const ArrayXd a = (delta > eps * delta1).select(deltaInv, 
+                    (delta1 == 0).select(0., eps2Inv * delta * deltaInv1 * deltaInv1));
+            const ArrayXd b = (delta > eps * delta1).select(-lambda1 * deltaInv, 
+                    (delta1 == 0).select(0., -eps2Inv * deltaInv1));
+            writeJacobian(jac1, a, b, jacDelta1V, jacDeltaIOmega, jacDeltaV, jacDeltaOmega);
+        }
+        if (jac2 != NULL)
+        {
+            const ArrayX3d jacDelta2V = scaleArr(2 * rp, tArr) - scaleArr(tp, rArr) - scaleArr(tr, pArr);
+            crossArr(qArr, tt * pArr - scaleArr(tp, tArr), jacDeltaIOmega);
+            // regular case : a = 1 / delta, b = -res2 / delta
+            // extrapolated case : a = delta / (eps^2 delta2^2), b = -1 / (eps^2 delta2)
+            const ArrayXd deltaInv2 = 1. / delta2;
+            const ArrayXd a = (delta > eps * delta2).select(deltaInv, 
+                    (delta2 == 0).select(0., eps2Inv * delta * deltaInv2 * deltaInv2));
+            const ArrayXd b = (delta > eps * delta2).select(-lambda2 * deltaInv, 
+                    (delta2 == 0).select(0., -eps2Inv * deltaInv2));
+            writeJacobian(jac2, a, b, jacDelta2V, jacDeltaIOmega, jacDeltaV, jacDeltaOmega);
+        }
+    }
+}
+
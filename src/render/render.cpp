@@ -20,6 +20,7 @@ along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
 #include "timer.h"
 
 #include "projection/eucm.h"
+#include "projection/lookup_camera.h"
 
 #include "render/background.h"
 #include "render/plane.h"
@@ -74,7 +75,8 @@ void RenderDevice::setCamera(const ICamera * camera)
     {
         delete _camera;
     }
-    _camera = camera->clone(); //TODO check the size and reinit the buffers
+    // the same pixel grid is reconstructed for every frame
+    _camera = new LookupCamera(camera); //TODO check the size and reinit the buffers
 }
 
 void RenderDevice::render(Mat8u & dst)
@@ -0,0 +1,152 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+A round trip through the keyframe database file:
+the keyframes are written, the file is reopened and read back,
+then the last record is truncated as by an interrupted write
+*/
+
+#include <cstdio>
+#include <unistd.h>
+
+#include "localization/keyframe_database.h"
+
+#include "std.h"
+#include "eigen.h"
+#include "ocv.h"
+#include "io.h"
+
+#include "geometry/geometry.h"
+
+using namespace std;
+
+const int NUM_KEYFRAMES = 10;
+
+Mat8u makeImage(int seed)
+{
+    Mat8u img(30 + seed, 40);
+    for (int v = 0; v < img.rows; v++)
+    {
+        for (int u = 0; u < img.cols; u++)
+        {
+            img(v, u) = (7 * (v * img.cols + u) + seed) % 251;
+        }
+    }
+    return img;
+}
+
+Transf makePose(int seed)
+{
+    return Transf(seed, 2 * seed, -0.5 * seed, 0.01 * seed, 0, 0.1 * seed);
+}
+
+bool isSame(const Mat8u & img, int seed)
+{
+    const Mat8u ref = makeImage(seed);
+    if (img.rows != ref.rows or img.cols != ref.cols) return false;
+    for (int v = 0; v < img.rows; v++)
+    {
+        for (int u = 0; u < img.cols; u++)
+        {
+            if (img(v, u) != ref(v, u)) return false;
+        }
+    }
+    return true;
+}
+
+bool isSame(const Transf & xi, int seed)
+{
+    const Transf ref = makePose(seed);
+    return xi.trans() == ref.trans() and xi.rot() == ref.rot();
+}
+
+// checks the keyframes 0 .. n-1, in reverse order to go through the eviction
+int countMismatches(KeyframeDatabase & database, int n)
+{
+    int numFailed = 0;
+    for (int i = n - 1; i >= 0; i--)
+    {
+        if (not isSame(database.image(i), i) or not isSame(database.pose(i), i)) numFailed++;
+    }
+    return numFailed;
+}
+
+int main(int argc, char const * argv[])
+{
+    const string fileName = (argc > 1) ? argv[1] : "keyframe_database_test.bin";
+    remove(fileName.c_str());
+    int numFailed = 0;
+
+    // write, with fewer resident images than keyframes
+    {
+        KeyframeDatabase database(3);
+        if (not database.open(fileName))
+        {
+            cout << fileName << " : ERROR, cannot create the file" << endl;
+            return 1;
+        }
+        for (int i = 0; i < NUM_KEYFRAMES; i++) database.add(makeImage(i), makePose(i));
+        numFailed += countMismatches(database, NUM_KEYFRAMES);
+        cout << "written : " << database.size() << " keyframes" << endl;
+    }
+
+    // reopen and read back
+    {
+        KeyframeDatabase database(2);
+        if (not database.open(fileName) or database.size() != NUM_KEYFRAMES) numFailed++;
+        else numFailed += countMismatches(database, NUM_KEYFRAMES);
+        cout << "reopened : " << database.size() << " keyframes" << endl;
+    }
+
+    // cut the last record, it is dropped and the next keyframe takes its place
+    FILE * file = fopen(fileName.c_str(), "rb");
+    fseek(file, 0, SEEK_END);
+    const long fileSize = ftell(file);
+    fclose(file);
+    if (truncate(fileName.c_str(), fileSize - 100) != 0) numFailed++;
+    {
+        KeyframeDatabase database;
+        if (not database.open(fileName) or database.size() != NUM_KEYFRAMES - 1) numFailed++;
+        cout << "truncated : " << database.size() << " keyframes" << endl;
+        database.add(makeImage(NUM_KEYFRAMES - 1), makePose(NUM_KEYFRAMES - 1));
+    }
+    {
+        KeyframeDatabase database;
+        if (not database.open(fileName) or database.size() != NUM_KEYFRAMES) numFailed++;
+        else numFailed += countMismatches(database, NUM_KEYFRAMES);
+        cout << "rewritten : " << database.size() << " keyframes" << endl;
+    }
+
+    // a file of another kind is not opened
+    file = fopen(fileName.c_str(), "wb");
+    fputs("not a keyframe database", file);
+    fclose(file);
+    {
+        KeyframeDatabase database;
+        if (database.open(fileName)) numFailed++;
+    }
+    remove(fileName.c_str());
+
+    if (numFailed > 0)
+    {
+        cout << "FAILED : " << numFailed << " mismatches" << endl;
+        return 1;
+    }
+    cout << "OK" << endl;
+    return 0;
+}
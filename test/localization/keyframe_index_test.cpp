@@ -0,0 +1,117 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+The grid queries of the keyframe index against a brute-force search
+over random positions, the queries span inside and far outside the cloud
+*/
+
+#include "localization/keyframe_index.h"
+
+#include "std.h"
+#include "eigen.h"
+#include "io.h"
+
+using namespace std;
+
+vector<int> bruteRadiusSearch(const Vector3dVec & positionVec,
+        const Vector3d & center, double radius)
+{
+    vector<int> res;
+    for (int i = 0; i < positionVec.size(); i++)
+    {
+        if ((positionVec[i] - center).squaredNorm() <= radius * radius) res.push_back(i);
+    }
+    return res;
+}
+
+vector<int> bruteNearest(const Vector3dVec & positionVec, const Vector3d & center, int k)
+{
+    vector<pair<double, int>> distVec;
+    for (int i = 0; i < positionVec.size(); i++)
+    {
+        distVec.emplace_back((positionVec[i] - center).squaredNorm(), i);
+    }
+    sort(distVec.begin(), distVec.end());
+    vector<int> res;
+    for (int i = 0; i < min<int>(k, distVec.size()); i++)
+    {
+        res.push_back(distVec[i].second);
+    }
+    return res;
+}
+
+int main(int argc, char const * argv[])
+{
+    mt19937 generator(1);
+    uniform_real_distribution<double> coordinate(-10, 10);
+
+    // the indices are not the insertion order, as for the keyframes of a map
+    const int OFFSET = 1000;
+    const double CELL_SIZE = 1.5;
+    KeyframeIndex index(CELL_SIZE);
+    Vector3dVec positionVec;
+    for (int i = 0; i < 500; i++)
+    {
+        positionVec.emplace_back(coordinate(generator), coordinate(generator), coordinate(generator));
+        index.insert(i + OFFSET, positionVec.back());
+    }
+
+    int numQueries = 0, numFailed = 0;
+    for (int q = 0; q < 200; q++)
+    {
+        // every fourth query is far from the points
+        const double spread = (q % 4 == 0) ? 10 : 1;
+        const Vector3d center(spread * coordinate(generator),
+                spread * coordinate(generator), spread * coordinate(generator));
+
+        for (double radius : {0.5, CELL_SIZE, 4.})
+        {
+            vector<int> res = index.radiusSearch(center, radius);
+            for (int & idx : res) idx -= OFFSET;
+            sort(res.begin(), res.end());
+            numQueries++;
+            if (res != bruteRadiusSearch(positionVec, center, radius))
+            {
+                cout << "radiusSearch mismatch at " << center.transpose()
+                        << " radius " << radius << endl;
+                numFailed++;
+            }
+        }
+
+        for (int k : {1, 5, 50, 600})
+        {
+            vector<int> res = index.nearest(center, k);
+            for (int & idx : res) idx -= OFFSET;
+            numQueries++;
+            if (res != bruteNearest(positionVec, center, k))
+            {
+                cout << "nearest mismatch at " << center.transpose() << " k " << k << endl;
+                numFailed++;
+            }
+        }
+    }
+
+    cout << numQueries << " queries, " << numFailed << " mismatches" << endl;
+    if (numFailed > 0)
+    {
+        cout << "FAILED" << endl;
+        return 1;
+    }
+    cout << "OK" << endl;
+    return 0;
+}
@@ -39,6 +39,8 @@ int main(int argc, char** argv)
    
     Transf xiMap;
     bool xiMapInit = false;
+    // the keyframes may be loaded from the database, only the map frame is needed then
+    const bool mapLoaded = not odom._frameVec.empty();
     // construct the map
     int mapCount = 0;
     for (auto & fileName : root.get_child("map_files"))
@@ -63,6 +65,7 @@ int main(int argc, char** argv)
             xiMapInit = true;
             xiMap = gtVec[0];
         }
+        if (mapLoaded) continue;
         ofstream fgt("gtMap" + to_string(mapCount) + ".txt");
         for (int i = 0; i < fnameVec.size(); i++)
         {
@@ -0,0 +1,121 @@
+/*
+This file is part of visgeom.
+
+visgeom is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+visgeom is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with visgeom.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+The Levenberg-Marquardt pose solver on a synthetic point alignment problem:
+the points X are observed in the frame xi as Y = xi^-1 X,
+the pose is recovered from a perturbed initial guess
+*/
+
+#include <memory>
+
+#include "localization/pose_solver.h"
+
+#include "std.h"
+#include "eigen.h"
+#include "ceres.h"
+#include "io.h"
+
+#include "geometry/geometry.h"
+
+using namespace std;
+
+// r = xi^-1 X - Y, the Jacobian is computed by central differences
+struct PointAlignment : ceres::SizedCostFunction<3, 6>
+{
+    PointAlignment(const Vector3d & X, const Vector3d & Y) : X(X), Y(Y) {}
+
+    void computeResidual(const double * pose, double * residual) const
+    {
+        Transf xi(pose);
+        Vector3d Xi;
+        xi.inverseTransform(X, Xi);
+        Map<Vector3d> res(residual);
+        res = Xi - Y;
+    }
+
+    virtual bool Evaluate(double const * const * params,
+            double * residual, double ** jacobian) const
+    {
+        computeResidual(params[0], residual);
+        if (jacobian != NULL and jacobian[0] != NULL)
+        {
+            const double EPS = 1e-6;
+            for (int k = 0; k < 6; k++)
+            {
+                array<double, 6> posePlus, poseMinus;
+                copy(params[0], params[0] + 6, posePlus.begin());
+                copy(params[0], params[0] + 6, poseMinus.begin());
+                posePlus[k] += EPS;
+                poseMinus[k] -= EPS;
+                Vector3d resPlus, resMinus;
+                computeResidual(posePlus.data(), resPlus.data());
+                computeResidual(poseMinus.data(), resMinus.data());
+                for (int i = 0; i < 3; i++)
+                {
+                    jacobian[0][i * 6 + k] = (resPlus[i] - resMinus[i]) / (2 * EPS);
+                }
+            }
+        }
+        return true;
+    }
+
+    Vector3d X, Y;
+};
+
+int main(int argc, char const * argv[])
+{
+    const Transf xiTrue(0.3, -0.2, 0.5, 0.2, -0.1, 0.3);
+
+    mt19937 generator(1);
+    normal_distribution<double> normal;
+    vector<unique_ptr<PointAlignment>> costVec;
+    vector<unique_ptr<DenseNormalEquationTerm>> termVec;
+    for (int i = 0; i < 50; i++)
+    {
+        const Vector3d X(normal(generator), normal(generator), normal(generator) + 3);
+        Vector3d Y;
+        xiTrue.inverseTransform(X, Y);
+        costVec.emplace_back(new PointAlignment(X, Y));
+        termVec.emplace_back(new DenseNormalEquationTerm(costVec.back().get()));
+    }
+
+    PoseSolverOptions options;
+    options.functionTolerance = 1e-12;
+    options.parameterTolerance = 1e-12;
+    PoseSolver solver(options);
+    for (auto & term : termVec) solver.addTerm(term.get());
+
+    array<double, 6> pose = Transf(0.2, -0.1, 0.3, 0.1, 0, 0.1).toArray();
+    PoseSolverSummary summary = solver.solve(pose.data());
+
+    const Transf xiEst(pose.data());
+    const double errTrans = (xiEst.trans() - xiTrue.trans()).norm();
+    const double errRot = (xiEst.rot() - xiTrue.rot()).norm();
+    cout << "true pose      : " << xiTrue << endl;
+    cout << "estimated pose : " << xiEst << endl;
+    cout << "iterations : " << summary.iterations << "  converged : " << summary.converged
+            << "  cost : " << summary.initialCost << " -> " << summary.finalCost << endl;
+
+    if (errTrans > 1e-6 or errRot > 1e-6 or not (summary.finalCost < summary.initialCost))
+    {
+        cout << "FAILED : translation error " << errTrans << " rotation error " << errRot << endl;
+        return 1;
+    }
+    cout << "OK" << endl;
+    return 0;
+}